@@ -63,6 +63,11 @@
 #define PICO_DEFAULT_I2C_SCL_PIN 7
 #endif
 
+//------------- HDMI HPD -------------//
+// Not wired, this board has no hot plug detect and CEC_HPD_PIN is left
+// undefined. HDMI pin 19 is 5V, so a GPIO added for it with the CEC_HPD_PIN
+// CMake option needs a divider.
+
 //------------- SPI -------------//
 #ifndef PICO_DEFAULT_SPI
 #define PICO_DEFAULT_SPI 0
@@ -1,12 +1,10 @@
 #ifndef CEC_CONFIG_H
 #define CEC_CONFIG_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
-typedef struct {
-  const char *name;
-  uint8_t key;
-} command_t;
+#include "hid-macro.h"
 
 typedef enum {
   CEC_CONFIG_KEYMAP_CUSTOM = 0,
@@ -25,6 +23,10 @@ typedef enum {
 
 /**
  * CEC configuration in-memory.
+ *
+ * Also stored as is in NVS, any change to the layout needs a new NVS version.
+ * Every task holds a copy, so the HID macros are kept apart from it, see
+ * cec_config_get_macro().
  */
 typedef struct {
   /** DDC EDID delay in milliseconds. */
@@ -42,13 +44,54 @@ typedef struct {
   /** Keymap configuration. */
   cec_config_keymap_t keymap_type;
 
-  /** User Control key mapping table. */
-  command_t keymap[UINT8_MAX];
+  /**
+   * User Control key mapping table.
+   *
+   * HID key (or macro reference) indexed by CEC user control code, 0x00 if
+   * unmapped. Names are looked up with cec_user_control_name().
+   */
+  uint8_t keymap[UINT8_MAX];
+
+  /** HID endpoint polling interval in milliseconds. */
+  uint8_t hid_interval_ms;
+
+  /** Also claim the audio system logical address, besides device_type. */
+  bool audio_system;
 } cec_config_t;
 
 void cec_config_set_keymap(cec_config_t *config);
 void cec_config_set_default(cec_config_t *config);
 
-void cec_config_complete(cec_config_t *config);
+/**
+ * Live configuration.
+ *
+ * A single shared configuration, loaded from NVS at boot and replaced as a
+ * whole by cec_config_set(). Readers take consistent snapshots without
+ * locking (seqlock), retrying if they overlap a write.
+ */
+void cec_config_init(void);
+
+/** Copy a snapshot of the live configuration, returns its version. */
+uint32_t cec_config_get(cec_config_t *config);
+
+/**
+ * Copy a single macro program from the live configuration.
+ *
+ * There is a single copy of the macros, loaded from NVS at boot, they are
+ * referenced by keymap entries and read when one is pressed.
+ */
+bool cec_config_get_macro(uint8_t index, uint8_t code[HID_MACRO_LENGTH]);
+
+/** Replace a single live macro program, task context only. */
+bool cec_config_set_macro(uint8_t index, const uint8_t code[HID_MACRO_LENGTH]);
+
+/** Save the live macros to NVS, task context only. */
+bool cec_config_save_macros(void);
+
+/** Current live configuration version, changes on every cec_config_set(). */
+uint32_t cec_config_version(void);
+
+/** Replace the live configuration, task context only. */
+void cec_config_set(const cec_config_t *config);
 
 #endif
@@ -8,7 +8,14 @@
 #define CEC_PIN 3  // GPIO3 == D10 (Seeed Studio XIAO RP2040)
 #endif
 
-extern TaskHandle_t xCECTask;
+/** A second CEC bus is served if CEC_PIN_2 is defined. */
+#ifdef CEC_PIN_2
+#define CEC_BUS_COUNT (2)
+#else
+#define CEC_BUS_COUNT (1)
+#endif
+
+typedef struct cec_bus_t cec_bus_t;
 
 typedef struct {
   uint8_t *data;
@@ -31,6 +38,8 @@ typedef enum {
 } cec_frame_state_t;
 
 typedef struct cec_frame_t {
+  /** Bus the frame is sent or received on. */
+  cec_bus_t *bus;
   cec_message_t *message;
   unsigned int bit;
   unsigned int byte;
@@ -38,8 +47,11 @@ typedef struct cec_frame_t {
   bool first;
   bool eom;
   bool ack;
-  uint8_t address;
+  /** Logical addresses acknowledged, bit n for address n. */
+  uint16_t addresses;
   cec_frame_state_t state;
+  /** Flash operation sequence at the start of the frame. */
+  uint32_t flash;
 } cec_frame_t;
 
 /* @todo need atomics for thread sync safety */
@@ -48,11 +60,66 @@ typedef struct {
   uint32_t tx_frames;
   uint32_t rx_abort_frames;
   uint32_t tx_noack_frames;
+  /** Frames overlapping a flash operation. */
+  uint32_t flash_frames;
+  /** Aborted or unacknowledged frames overlapping a flash operation. */
+  uint32_t flash_errors;
 } cec_frame_stats_t;
 
-void cec_frame_init(void);
-void cec_frame_get_stats(cec_frame_stats_t *stats);
-bool cec_frame_send(uint8_t pldcnt, uint8_t *pld);
-uint8_t cec_frame_recv(uint8_t *pld, uint8_t address);
+/**
+ * CEC bus, one per HDMI chain.
+ *
+ * Each bus has its own pin and receive state and is owned by the task which
+ * initialised it, only that task may send or receive on it.
+ */
+struct cec_bus_t {
+  /** CEC GPIO pin. */
+  uint8_t pin;
+  /** Task sending and receiving on the bus, NULL until initialised. */
+  TaskHandle_t task;
+  /** Frame being received. */
+  uint8_t rx_buffer[16];
+  cec_message_t rx_message;
+  cec_frame_t rx_frame;
+  /** Time of the last bus edge, 32 bits so the ISR update is atomic. */
+  volatile uint32_t activity_us;
+  cec_frame_stats_t stats;
+};
+
+/** Get bus index, 0 to CEC_BUS_COUNT - 1. */
+cec_bus_t *cec_frame_bus(unsigned int index);
+
+/** Initialise the bus pin, the calling task becomes the bus owner. */
+void cec_frame_init(cec_bus_t *bus);
+void cec_frame_get_stats(const cec_bus_t *bus, cec_frame_stats_t *stats);
+bool cec_frame_send(cec_bus_t *bus, uint8_t pldcnt, uint8_t *pld);
+
+/**
+ * Receive a frame, acknowledging it if directed to any of the logical
+ * addresses, bit n for address n.
+ */
+uint8_t cec_frame_recv(cec_bus_t *bus, uint8_t *pld, uint16_t addresses);
+
+/**
+ * Wake cec_frame_recv() early on every bus, it returns 0 unless a frame has
+ * started.
+ *
+ * The wake is counted, so one sent while a CEC task is sending or handling a
+ * frame is not lost, its next receive returns 0 straight away.
+ */
+void cec_frame_wake(void);
+
+/**
+ * Microseconds since the last activity on any CEC bus, 0 if a bus is low.
+ */
+uint32_t cec_frame_idle_us(void);
+
+/**
+ * Mark the start and end of a flash operation.
+ *
+ * Frames overlapping a flash operation are counted in the statistics.
+ */
+void cec_frame_flash_begin(void);
+void cec_frame_flash_end(void);
 
 #endif
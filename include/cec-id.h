@@ -52,4 +52,53 @@ typedef enum {
   CEC_ABORT_UNDETERMINED = 5,
 } cec_abort_t;
 
+/**
+ * CEC opcode names, keep sorted by opcode.
+ */
+#define CEC_MESSAGE_NAMES(X, t)                                        \
+  X(t, CEC_ID_FEATURE_ABORT, "Feature Abort")                          \
+  X(t, CEC_ID_IMAGE_VIEW_ON, "Image View On")                          \
+  X(t, CEC_ID_TEXT_VIEW_ON, "Text View On")                            \
+  X(t, CEC_ID_STANDBY, "Standby")                                      \
+  X(t, CEC_ID_USER_CONTROL_PRESSED, "User Control Pressed")            \
+  X(t, CEC_ID_USER_CONTROL_RELEASED, "User Control Released")          \
+  X(t, CEC_ID_GIVE_OSD_NAME, "Give OSD Name")                          \
+  X(t, CEC_ID_SET_OSD_NAME, "Set OSD Name")                            \
+  X(t, CEC_ID_SYSTEM_AUDIO_MODE_REQUEST, "System Audio Mode Request")  \
+  X(t, CEC_ID_GIVE_AUDIO_STATUS, "Give Audio Status")                  \
+  X(t, CEC_ID_SET_SYSTEM_AUDIO_MODE, "Set System Audio Mode")          \
+  X(t, CEC_ID_REPORT_AUDIO_STATUS, "Report Audio Status")              \
+  X(t, CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS, "Give System Audio Mode") \
+  X(t, CEC_ID_SYSTEM_AUDIO_MODE_STATUS, "System Audio Mode Status")    \
+  X(t, CEC_ID_ROUTING_CHANGE, "Routing Change")                        \
+  X(t, CEC_ID_GET_MENU_LANGUAGE, "Get Menu Language")                  \
+  X(t, CEC_ID_ACTIVE_SOURCE, "Active Source")                          \
+  X(t, CEC_ID_GIVE_PHYSICAL_ADDRESS, "Give Physical Address")          \
+  X(t, CEC_ID_REPORT_PHYSICAL_ADDRESS, "Report Physical Address")      \
+  X(t, CEC_ID_REQUEST_ACTIVE_SOURCE, "Request Active Source")          \
+  X(t, CEC_ID_SET_STREAM_PATH, "Set Stream Path")                      \
+  X(t, CEC_ID_DEVICE_VENDOR_ID, "Device Vendor ID")                    \
+  X(t, CEC_ID_GIVE_DEVICE_VENDOR_ID, "Give Device Vendor ID")          \
+  X(t, CEC_ID_MENU_REQUEST, "Menu Request")                            \
+  X(t, CEC_ID_MENU_STATUS, "Menu Status")                              \
+  X(t, CEC_ID_GIVE_DEVICE_POWER_STATUS, "Give Device Power Status")    \
+  X(t, CEC_ID_REPORT_POWER_STATUS, "Report Power Status")              \
+  X(t, CEC_ID_INACTIVE_SOURCE, "Inactive Source")                      \
+  X(t, CEC_ID_CEC_VERSION, "CEC Version")                              \
+  X(t, CEC_ID_GET_CEC_VERSION, "Get CEC Version")                      \
+  X(t, CEC_ID_VENDOR_COMMAND_WITH_ID, "Vendor Command With ID")        \
+  X(t, CEC_ID_REQUEST_ARC_INITIATION, "Request ARC Initiation")        \
+  X(t, CEC_ID_ABORT, "Abort")
+
+/**
+ * Feature abort reasons, keep sorted by reason.
+ */
+#define CEC_FEATURE_ABORT_NAMES(X, t)                              \
+  X(t, CEC_ABORT_UNRECOGNIZED, "Unrecognized opcode")              \
+  X(t, CEC_ABORT_INCORRECT_MODE, "Not in correct mode to respond") \
+  X(t, CEC_ABORT_NO_SOURCE, "Cannot provide source")               \
+  X(t, CEC_ABORT_INVALID, "Invalid operand")                       \
+  X(t, CEC_ABORT_REFUSED, "Refused")                               \
+  X(t, CEC_ABORT_UNDETERMINED, "Undetermined")
+
 #endif
@@ -3,19 +3,120 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "usb-cdc.h"
 
 #define _LOG_BR _CDC_BR
 
+/** Log severity levels. */
+#define CEC_LOG_LEVEL_NONE (0)
+#define CEC_LOG_LEVEL_ERROR (1)
+#define CEC_LOG_LEVEL_WARN (2)
+#define CEC_LOG_LEVEL_INFO (3)
+#define CEC_LOG_LEVEL_DEBUG (4)
+
+/**
+ * Compile time log level.
+ *
+ * Messages more verbose than this level are compiled out entirely, including
+ * their arguments.
+ */
+#ifndef CEC_LOG_LEVEL
+#define CEC_LOG_LEVEL CEC_LOG_LEVEL_INFO
+#endif
+
+/** Log modules, each may be enabled at runtime independently. */
+typedef enum {
+  CEC_LOG_PHY = 0,
+  CEC_LOG_PROTOCOL,
+  CEC_LOG_DDC,
+  CEC_LOG_NVS,
+  CEC_LOG_USB,
+  CEC_LOG_MODULE_MAX,
+} cec_log_module_t;
+
+#define CEC_LOG_MODULE_ALL ((1UL << CEC_LOG_MODULE_MAX) - 1)
+
+/** Runtime module mask, use cec_log_enable()/cec_log_disable() to change. */
+extern volatile uint32_t cec_log_modules;
+
+#define cec_log_module_enabled(module) ((cec_log_modules & (1UL << (module))) != 0)
+
+/**
+ * Log a message for a module at a level.
+ *
+ * The level test is a compile time constant and the module test is a single
+ * load, both happen before any argument is evaluated.
+ */
+#define CEC_LOG(level, module, fmt, ...)                                \
+  do {                                                                  \
+    if (((level) <= CEC_LOG_LEVEL) && cec_log_module_enabled(module)) { \
+      cec_log_submitf(fmt _LOG_BR, ##__VA_ARGS__);                      \
+    }                                                                   \
+  } while (0)
+
+#define CEC_LOG_ERROR(module, fmt, ...) CEC_LOG(CEC_LOG_LEVEL_ERROR, module, fmt, ##__VA_ARGS__)
+#define CEC_LOG_WARN(module, fmt, ...) CEC_LOG(CEC_LOG_LEVEL_WARN, module, fmt, ##__VA_ARGS__)
+#define CEC_LOG_INFO(module, fmt, ...) CEC_LOG(CEC_LOG_LEVEL_INFO, module, fmt, ##__VA_ARGS__)
+#define CEC_LOG_DEBUG(module, fmt, ...) CEC_LOG(CEC_LOG_LEVEL_DEBUG, module, fmt, ##__VA_ARGS__)
+
+/**
+ * Events logged from interrupt context.
+ *
+ * Only the event and its arguments are captured, the line is formatted by the
+ * log task.
+ */
+typedef enum {
+  CEC_LOG_EVENT_RX_START_LOW = 0,
+  CEC_LOG_EVENT_RX_START_PERIOD,
+  CEC_LOG_EVENT_RX_BIT_PERIOD,
+  CEC_LOG_EVENT_RX_DATA_LOW,
+  CEC_LOG_EVENT_RX_ACK_LOW,
+  CEC_LOG_EVENT_MAX,
+} cec_log_event_t;
+
+#define CEC_LOG_EVENT_ARGS (3)
+
+/**
+ * Log an event for a module at a level, safe in interrupt context.
+ *
+ * Up to CEC_LOG_EVENT_ARGS arguments, the rest are zero.
+ */
+#define CEC_LOG_EVENT(level, module, event, ...)                                 \
+  do {                                                                           \
+    if (((level) <= CEC_LOG_LEVEL) && cec_log_module_enabled(module)) {          \
+      cec_log_event((event), (const uint32_t[CEC_LOG_EVENT_ARGS]){__VA_ARGS__}); \
+    }                                                                            \
+  } while (0)
+
+#define CEC_LOG_WARN_EVENT(module, event, ...) \
+  CEC_LOG_EVENT(CEC_LOG_LEVEL_WARN, module, event, __VA_ARGS__)
+
 typedef struct cec_frame_t cec_frame_t;
 typedef void (*log_callback_t)(const char *str);
 
+typedef struct {
+  /** Lines queued. */
+  uint32_t lines;
+  /** Lines dropped, the queue was full. */
+  uint32_t dropped;
+  /** Lines cut short, too long for a queue slot. */
+  uint32_t truncated;
+  /** Maximum number of lines ever waiting in the queue. */
+  uint32_t high_water;
+  /** CEC frames not logged, the frame queue was full. */
+  uint32_t frames_dropped;
+} cec_log_stats_t;
+
 void cec_log_init(log_callback_t log);
-bool cec_log_enabled();
-void cec_log_enable(void);
-void cec_log_disable(void);
+uint32_t cec_log_enabled(void);
+void cec_log_enable(uint32_t mask);
+void cec_log_disable(uint32_t mask);
+const char *cec_log_module_name(cec_log_module_t module);
 void cec_log_frame(cec_frame_t *frame, bool recv);
+void cec_log_event(cec_log_event_t event, const uint32_t args[CEC_LOG_EVENT_ARGS]);
+void cec_log_get_stats(cec_log_stats_t *stats);
 void cec_log_vsubmitf(const char *fmt, va_list ap);
 __attribute__((format(printf, 1, 2))) void cec_log_submitf(const char *fmt, ...);
 
@@ -4,9 +4,21 @@
 #include <stdint.h>
 
 #define CEC_TASK_NAME "cec"
+#define CEC_TASK_NAME_2 "cec2"
 
-uint16_t cec_get_physical_address(void);
-uint8_t cec_get_logical_address(void);
+/**
+ * cec_task parameters, one task per CEC bus.
+ */
+typedef struct {
+  /** Bus index, the first bus has its physical address from EDID. */
+  unsigned int bus;
+} cec_task_param_t;
+
+uint16_t cec_get_physical_address(unsigned int bus);
+uint8_t cec_get_logical_address(unsigned int bus);
+
+/** Every logical address claimed on the bus, bit n for address n. */
+uint16_t cec_get_logical_addresses(unsigned int bus);
 void cec_task(void *param);
 
 #endif
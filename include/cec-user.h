@@ -46,7 +46,52 @@ typedef enum {
   CEC_USER_F5 = 0x75,
 } cec_user_t;
 
-/** Mapping from CEC user code to human readable string. */
-extern const char *cec_user_control_name[UINT8_MAX];
+/** Get the human readable name of a CEC user code, NULL if unknown. */
+const char *cec_user_control_name(uint8_t code);
+
+/**
+ * Official table of CEC User Control codes to human-readable names.
+ *
+ * From "High-Definition Multimedia Interface Specification Version 1.3, CEC
+ * Table 23, User Control Codes, p. 62"
+ *
+ * @note Incomplete, add as required, keep sorted by code.
+ */
+#define CEC_USER_CONTROL_NAMES(X, t)                 \
+  X(t, CEC_USER_SELECT, "Select")                    \
+  X(t, CEC_USER_UP, "Up")                            \
+  X(t, CEC_USER_DOWN, "Down")                        \
+  X(t, CEC_USER_LEFT, "Left")                        \
+  X(t, CEC_USER_RIGHT, "Right")                      \
+  X(t, CEC_USER_RIGHT_UP, "Right-Up")                \
+  X(t, CEC_USER_RIGHT_DOWN, "Right-Down")            \
+  X(t, CEC_USER_LEFT_UP, "Left-Up")                  \
+  X(t, CEC_USER_LEFT_DOWN, "Left-Down")              \
+  X(t, CEC_USER_OPTIONS, "Options")                  \
+  X(t, CEC_USER_EXIT, "Exit")                        \
+  X(t, CEC_USER_0, "0")                              \
+  X(t, CEC_USER_1, "1")                              \
+  X(t, CEC_USER_2, "2")                              \
+  X(t, CEC_USER_3, "3")                              \
+  X(t, CEC_USER_4, "4")                              \
+  X(t, CEC_USER_5, "5")                              \
+  X(t, CEC_USER_6, "6")                              \
+  X(t, CEC_USER_7, "7")                              \
+  X(t, CEC_USER_8, "8")                              \
+  X(t, CEC_USER_9, "9")                              \
+  X(t, CEC_USER_DISPLAY_INFO, "Display Information") \
+  X(t, CEC_USER_VOLUME_UP, "Volume Up")              \
+  X(t, CEC_USER_VOLUME_DOWN, "Volume Down")          \
+  X(t, CEC_USER_PLAY, "Play")                        \
+  X(t, CEC_USER_STOP, "Stop")                        \
+  X(t, CEC_USER_PAUSE, "Pause")                      \
+  X(t, CEC_USER_REWIND, "Rewind")                    \
+  X(t, CEC_USER_FAST_FWD, "Fast Forward")            \
+  X(t, CEC_USER_SUB_PICTURE, "Sub Picture")          \
+  X(t, CEC_USER_F1_BLUE, "F1 (Blue)")                \
+  X(t, CEC_USER_F2_RED, "F2 (Red)")                  \
+  X(t, CEC_USER_F3_GREEN, "F3 (Green)")              \
+  X(t, CEC_USER_F4_YELLOW, "F4 (Yellow)")            \
+  X(t, CEC_USER_F5, "F5")
 
 #endif
@@ -0,0 +1,86 @@
+#ifndef CRASHLOG_H
+#define CRASHLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of protocol events retained, must be a power of 2. */
+#define CRASHLOG_EVENT_COUNT (32)
+
+/** Maximum task name length, matches configMAX_TASK_NAME_LEN. */
+#define CRASHLOG_TASK_NAME_LEN (16)
+
+/** Event flags. */
+#define CRASHLOG_EVENT_RX (0x01)
+#define CRASHLOG_EVENT_ACK (0x02)
+#define CRASHLOG_EVENT_ABORT (0x04)
+/** Held while an event is written, so one torn by a crash shows as damaged. */
+#define CRASHLOG_EVENT_INVALID (0x80)
+
+typedef enum {
+  /** Reset without a recorded cause (eg. RUN pin, reboot), the log is not kept. */
+  CRASHLOG_REASON_RESET = 0,
+  /** Hard fault exception. */
+  CRASHLOG_REASON_HARDFAULT = 1,
+  /** FreeRTOS task stack overflow. */
+  CRASHLOG_REASON_STACK_OVERFLOW = 2,
+  /** Watchdog timeout, the system hung. */
+  CRASHLOG_REASON_WATCHDOG = 3,
+} crashlog_reason_t;
+
+/**
+ * CEC frame summary, header and opcode only.
+ */
+typedef struct {
+  uint32_t timestamp_ms;
+  uint8_t flags;
+  uint8_t len;
+  uint8_t data[2];
+} crashlog_event_t;
+
+/**
+ * Exception frame as stacked on fault entry.
+ */
+typedef struct {
+  uint32_t r0;
+  uint32_t r1;
+  uint32_t r2;
+  uint32_t r3;
+  uint32_t r12;
+  uint32_t lr;
+  uint32_t pc;
+  uint32_t xpsr;
+} crashlog_regs_t;
+
+/**
+ * Crash log.
+ *
+ * Events are recorded as they happen, the cause is filled in by a crash.
+ */
+typedef struct {
+  uint32_t reason;
+  char task[CRASHLOG_TASK_NAME_LEN];
+  crashlog_regs_t regs;
+  /** Time of the crash, or of the last event. */
+  uint32_t uptime_ms;
+  /** Free running index of the next event. */
+  uint32_t head;
+  crashlog_event_t events[CRASHLOG_EVENT_COUNT];
+} crashlog_t;
+
+/** Validate and keep the previous boot's log, then start a new one. */
+void crashlog_init(void);
+
+/** Get the previous boot's log, NULL if none was retained. */
+const crashlog_t *crashlog_get(void);
+
+/** Record a CEC frame, called from cec_task. */
+void crashlog_event(uint8_t flags, const uint8_t *data, uint8_t len);
+
+/** Record a stack overflow in the named task. */
+__attribute__((noreturn)) void crashlog_stack_overflow(const char *task);
+
+/** Name of a crash reason. */
+const char *crashlog_reason_name(uint32_t reason);
+
+#endif
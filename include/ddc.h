@@ -2,8 +2,115 @@
 #define HDMI_DDC_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "FreeRTOS.h"
+
+#include "edid.h"
+
+/**
+ * DDC bus speed.
+ */
+typedef enum {
+  /** Standard mode, 100 kHz. */
+  DDC_SPEED_STANDARD = 0,
+  /** Fast mode, 400 kHz. */
+  DDC_SPEED_FAST = 1,
+  DDC_SPEED_COUNT,
+} ddc_speed_t;
+
+/**
+ * Outcome of a requested EDID read.
+ */
+typedef enum {
+  /** Read, the cached result is fresh. */
+  DDC_RESULT_OK = 0,
+  /** Bus error, bad checksum or cancelled, the cached result is stale. */
+  DDC_RESULT_FAILED = 1,
+  /** Still in progress. */
+  DDC_RESULT_TIMEOUT = 2,
+} ddc_result_t;
+
+typedef struct {
+  /** Per bus speed, indexed by ddc_speed_t. */
+  struct {
+    /** Successful EDID reads. */
+    uint32_t reads;
+    /** Failed EDID reads, bus errors, timeouts and bad checksums. */
+    uint32_t errors;
+    /** Duration of the last and slowest successful read. */
+    uint32_t last_us;
+    uint32_t max_us;
+  } speed[DDC_SPEED_COUNT];
+  /** Speed of the next read. */
+  ddc_speed_t current;
+  /** Debounced hot plug detect changes. */
+  uint32_t hpd_events;
+} ddc_stats_t;
+
+/**
+ * DDC engine.
+ *
+ * EDID is read by the ddc task with DMA, so callers never block on the bus.
+ * Reads are requested with ddc_refresh() and the result cached. The physical
+ * address of the last sink is also kept in NVS, so it is known at boot before
+ * any read. The boot read only checks block 0 to confirm it is the same sink,
+ * every later read goes on to the CTA extension with the physical address.
+ *
+ * Sinks are read in fast mode, falling back to standard mode if that fails,
+ * and the speed which worked is remembered with the sink.
+ *
+ * If the board defines CEC_HPD_PIN, the EDID is also read whenever hot plug
+ * detect is asserted, and the CEC task woken if the physical address changed.
+ * When it is deasserted the physical address reads 0x0000 until then.
+ */
+void ddc_init(void);
+
+void ddc_get_stats(ddc_stats_t *stats);
+
+/** Bus frequency of a speed in Hz. */
+uint32_t ddc_get_frequency(ddc_speed_t speed);
+
+/** EDID blocks kept from the last read, block 0 and the first extension. */
+#define DDC_EDID_KEPT_BLOCKS (2)
+
+/**
+ * Copy the raw EDID kept from the last read, returns the number of bytes.
+ *
+ * If the boot read confirmed the same sink only block 0 was read again, the
+ * kept extension is then from an earlier read of that sink.
+ */
+size_t ddc_get_edid(uint8_t *edid, size_t len);
+
+/** Physical address from the last successful EDID read, 0x0000 if none. */
 uint16_t ddc_get_physical_address(void);
 
+/**
+ * Capabilities decoded from the last sink's EDID, cached so callers never wait
+ * on the bus. Returns false if no EDID has been read, even on a previous boot.
+ */
+bool ddc_get_info(edid_info_t *info);
+
+/** Check if the physical address was cached from a previous boot. */
+bool ddc_has_cached_address(void);
+
+/** Request an EDID read, returns immediately. */
+void ddc_refresh(void);
+
+/**
+ * Request a read to confirm the cached sink after a delay, returns immediately.
+ *
+ * Only block 0 is read if it matches the cached sink, so this is meant for the
+ * first read after boot, ddc_refresh() reads on to the physical address.
+ */
+void ddc_confirm_delayed(TickType_t delay);
+
+/** Cancel the EDID read in progress, the cached result is kept. */
+void ddc_cancel(void);
+
+/** Request an EDID read and wait for it to complete. */
+ddc_result_t ddc_refresh_wait(TickType_t timeout);
+
 #endif
@@ -0,0 +1,111 @@
+#ifndef EDID_H
+#define EDID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * EDID parser.
+ *
+ * Parses the bytes read from the sink, independent of how they were read. It
+ * has no SDK or RTOS dependencies, so it can also be built and run on a host.
+ */
+
+#define EDID_BLOCK_SIZE (128)
+
+typedef enum {
+  /** More blocks are needed. */
+  EDID_PARSE_MORE = 0,
+  /** Finished, with or without a physical address. */
+  EDID_PARSE_DONE = 1,
+  /** Invalid EDID. */
+  EDID_PARSE_ERROR = 2,
+} edid_parse_t;
+
+/** Monitor name length, a display descriptor holds up to 13 characters. */
+#define EDID_NAME_LENGTH (13)
+
+/** CTA short audio descriptor format codes, as bits in audio_formats. */
+#define EDID_AUDIO_LPCM (1 << 1)
+#define EDID_AUDIO_AC3 (1 << 2)
+#define EDID_AUDIO_DTS (1 << 7)
+#define EDID_AUDIO_EAC3 (1 << 10)
+#define EDID_AUDIO_DTS_HD (1 << 11)
+#define EDID_AUDIO_TRUEHD (1 << 12)
+
+/**
+ * Sink capabilities, decoded from the blocks read.
+ *
+ * Only the CTA extension holding the HDMI VSDB is decoded, later extensions
+ * are not read.
+ */
+typedef struct {
+  /** Manufacturer PNP ID, three letters. */
+  char manufacturer[4];
+  /** Monitor name, empty if none. */
+  char name[EDID_NAME_LENGTH + 1];
+  /** Physical address from the HDMI VSDB, 0x0000 if none. */
+  uint16_t physical_address;
+  /** HDMI VSDB Supports_AI, the sink accepts ACP, ISRC1 or ISRC2 packets. */
+  bool supports_ai;
+  /** Basic audio, from the CTA extension header. */
+  bool basic_audio;
+  /** Most channels of any short audio descriptor. */
+  uint8_t audio_channels;
+  /** Audio formats, bit n set for CTA audio format code n. */
+  uint16_t audio_formats;
+  /** Maximum TMDS clock in MHz, from the HDMI or HDMI Forum VSDB, 0 if none. */
+  uint16_t max_tmds_mhz;
+} edid_info_t;
+
+/**
+ * Incremental EDID parser state, fed one block at a time.
+ */
+typedef struct {
+  /** Total number of blocks, from the block 0 extension count. */
+  unsigned int blocks;
+  /** Decoded so far. */
+  edid_info_t info;
+} edid_parser_t;
+
+/**
+ * Sink identity, decoded from block 0.
+ */
+typedef struct {
+  /** Manufacturer PNP ID, three letters. */
+  char manufacturer[4];
+  /** Manufacturer product code. */
+  uint16_t product;
+  /** Serial number, 0 if unused. */
+  uint32_t serial;
+  /** Week of manufacture, 0 if unused, 0xff if year is the model year. */
+  uint8_t week;
+  /** Year of manufacture or model year. */
+  uint16_t year;
+  /** EDID version and revision. */
+  uint8_t version;
+  uint8_t revision;
+  /** Number of extension blocks. */
+  uint8_t extensions;
+} edid_identity_t;
+
+void edid_parser_init(edid_parser_t *parser);
+
+/** Decode the identity from block 0, returns false if it is not block 0. */
+bool edid_decode_identity(const uint8_t block[EDID_BLOCK_SIZE], edid_identity_t *identity);
+
+/** Check if the sink can play audio at all. */
+bool edid_has_audio(const edid_info_t *info);
+
+/** Check the block checksum, all bytes sum to zero. */
+bool edid_checksum_ok(const uint8_t block[EDID_BLOCK_SIZE]);
+
+/**
+ * Feed the next EDID block to the parser, starting with block 0.
+ *
+ * The block is trusted to be EDID_BLOCK_SIZE bytes, its contents are not.
+ */
+edid_parse_t edid_parse_block(edid_parser_t *parser, unsigned int index,
+                              const uint8_t block[EDID_BLOCK_SIZE]);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef HID_MACRO_H
+#define HID_MACRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of macro slots. */
+#define HID_MACRO_COUNT (8)
+
+/** Maximum length, in bytes, of a macro program. */
+#define HID_MACRO_LENGTH (32)
+
+/**
+ * Keymap values referring to a macro slot.
+ *
+ * HID usages 0xe8 to 0xff are reserved in the keyboard page, so we borrow
+ * 0xf0 onwards to reference macro slots from a keymap entry.
+ */
+#define HID_MACRO_KEY_BASE (0xf0)
+#define HID_MACRO_KEY(n) (HID_MACRO_KEY_BASE + (n))
+#define HID_MACRO_IS_KEY(k) \
+  ((k) >= HID_MACRO_KEY_BASE && (k) < (HID_MACRO_KEY_BASE + HID_MACRO_COUNT))
+
+/** Queued to the HID task to abort a running macro, also from the reserved range. */
+#define HID_MACRO_KEY_CANCEL (0xff)
+
+/**
+ * Macro bytecode.
+ *
+ * Each instruction is an opcode byte followed by its operand(s).
+ */
+typedef enum {
+  /** End of macro, all keys are released. */
+  HID_MACRO_OP_END = 0x00,
+  /** DOWN <key>: press key. */
+  HID_MACRO_OP_DOWN = 0x01,
+  /** UP <key>: release key. */
+  HID_MACRO_OP_UP = 0x02,
+  /** MOD <mask>: set the modifier mask (eg. KEYBOARD_MODIFIER_LEFTCTRL). */
+  HID_MACRO_OP_MOD = 0x03,
+  /** DELAY <lo> <hi>: wait for a little endian number of milliseconds. */
+  HID_MACRO_OP_DELAY = 0x04,
+  /**
+   * REPEAT <count>: restart from the beginning another count times.
+   *
+   * Only the first REPEAT reached is honoured, later ones are ignored.
+   */
+  HID_MACRO_OP_REPEAT = 0x05,
+} hid_macro_op_t;
+
+/**
+ * Macro executor state.
+ */
+typedef struct {
+  /** Macro program, copied so configuration changes cannot tear it. */
+  uint8_t code[HID_MACRO_LENGTH];
+  /** Program counter. */
+  uint8_t pc;
+  /** Location of the active REPEAT instruction, UINT8_MAX if none. */
+  uint8_t repeat_pc;
+  /** Remaining repeats of the active REPEAT instruction. */
+  uint8_t repeat;
+  /** Current HID modifier mask. */
+  uint8_t modifier;
+  /** Current HID keys pressed. */
+  uint8_t keycode[6];
+} hid_macro_t;
+
+/** Prepare to execute a macro program, returns false if empty. */
+bool hid_macro_start(hid_macro_t *macro, const uint8_t code[HID_MACRO_LENGTH]);
+
+/**
+ * Execute the macro up to the next report change or delay.
+ *
+ * Sets report to true if the modifier or keycode changed and a HID report
+ * should be sent.
+ *
+ * Returns the number of milliseconds to wait before the next step or -1 if
+ * the macro has completed.
+ */
+int32_t hid_macro_step(hid_macro_t *macro, bool *report);
+
+#endif
@@ -2,10 +2,38 @@
 #define NVS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "cec-config.h"
+#include "edid.h"
+#include "hid-macro.h"
 
-/** Read configuration from NVS. */
+/**
+ * EDID fingerprint of the last sink seen.
+ */
+typedef struct {
+  /** CRC32 of EDID block 0, identifies the sink (vendor, product, serial). */
+  uint32_t block_crc;
+
+  /** DDC bus speed (ddc_speed_t) which works for the sink. */
+  uint8_t speed;
+
+  /** Capabilities decoded from the EDID, including the physical address. */
+  edid_info_t info;
+} nvs_edid_t;
+
+/** Initialise NVS, call before any other NVS function. */
+void nvs_init(void);
+
+/**
+ * Stored configuration, used in place from the memory mapped flash.
+ *
+ * Validated once at boot (or on first use), NULL if there is none or it is an
+ * older version which must be migrated with nvs_read_config().
+ */
+const cec_config_t *nvs_get_config(void);
+
+/** Read configuration from NVS, migrating older versions. */
 bool nvs_read_config(cec_config_t *config);
 
 /** Read and apply configuration from NVS. */
@@ -14,4 +42,21 @@ void nvs_load_config(cec_config_t *config);
 /** Save configuration to NVS. */
 bool nvs_save_config(const cec_config_t *config);
 
+/** Read the cached EDID fingerprint, false if there is none. */
+bool nvs_read_edid(nvs_edid_t *edid);
+
+/** Save the EDID fingerprint, appended to the same log as the configuration. */
+bool nvs_save_edid(const nvs_edid_t *edid);
+
+/**
+ * Read the HID macros, false if none are stored.
+ *
+ * Macros have their own record, apart from the configuration, or are found in
+ * an older configuration until its first save.
+ */
+bool nvs_read_macros(uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH]);
+
+/** Save the HID macros, unless they are unchanged. */
+bool nvs_save_macros(const uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH]);
+
 #endif
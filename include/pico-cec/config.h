@@ -6,11 +6,12 @@
 #endif  // PICO_CEC_VERSION
 
 #define LED_STACK_SIZE (128)
-#define CEC_STACK_SIZE (1024)
+#define CEC_STACK_SIZE (768)
 #define HID_STACK_SIZE (256)
 #define USB_STACK_SIZE (512)
 #define LOG_STACK_SIZE (1024)
-#define CDC_STACK_SIZE (1024)
+#define CDC_STACK_SIZE (768)
+#define DDC_STACK_SIZE (512)
 
 #define CEC_QUEUE_LENGTH (16)
 
@@ -20,6 +21,7 @@
 #define USB_TASK_NAME "usb"
 #define LOG_TASK_NAME "log"
 #define CDC_TASK_NAME "cdc"
+#define DDC_TASK_NAME "ddc"
 
 #define LED_PRIORITY (1)
 #define CEC_PRIORITY (configMAX_PRIORITIES - 1)
@@ -27,5 +29,6 @@
 #define USB_PRIORITY (configMAX_PRIORITIES - 3)
 #define LOG_PRIORITY (configMAX_PRIORITIES - 4)
 #define CDC_PRIORITY (configMAX_PRIORITIES - 5)
+#define DDC_PRIORITY (configMAX_PRIORITIES - 4)
 
 #endif  // CONFIG_H
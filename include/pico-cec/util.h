@@ -1,8 +1,49 @@
 #ifndef PICO_CEC_UTIL_H
 #define PICO_CEC_UTIL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 uint64_t util_uptime_ms(void);
 
+/**
+ * Name table entry, the name is at offset in a packed string pool.
+ */
+typedef struct {
+  uint8_t key;
+  uint16_t offset;
+} util_name_t;
+
+/**
+ * Find the name for key in an index sorted by key, NULL if not found.
+ */
+const char *util_name_find(const util_name_t *index, size_t count, const char *pool, uint8_t key);
+
+#define UTIL_NAME_FIELD(table, key, name) char n_##key[sizeof(name)];
+#define UTIL_NAME_STRING(table, key, name) name,
+#define UTIL_NAME_INDEX(table, key, name) {(key), offsetof(struct table##_pool, n_##key)},
+
+/**
+ * Define a const name table from a list of (key, name) pairs.
+ *
+ * The list is a macro taking an X macro and an argument to pass through, eg.
+ *   #define NAMES(X, t) X(t, KEY_A, "A") X(t, KEY_B, "B")
+ * and must be sorted by key. The names are packed into a single string pool
+ * (a struct of char arrays, so no padding) indexed by a dense array of key
+ * and offset pairs, both kept in flash.
+ */
+#define UTIL_NAME_TABLE(table, list)                                                   \
+  struct table##_pool {                                                                \
+    list(UTIL_NAME_FIELD, table)                                                       \
+  };                                                                                   \
+  static const struct table##_pool __in_flash(#table) table##_pool = {                 \
+      list(UTIL_NAME_STRING, table)};                                                  \
+  _Static_assert(sizeof(table##_pool) <= UINT16_MAX, #table " string pool too large"); \
+  static const util_name_t __in_flash(#table) table##_index[] = {list(UTIL_NAME_INDEX, table)}
+
+/** Look up key in a table defined by UTIL_NAME_TABLE(). */
+#define UTIL_NAME_FIND(table, key)                                                \
+  util_name_find(table##_index, sizeof(table##_index) / sizeof(table##_index[0]), \
+                 (const char *)&table##_pool, (key))
+
 #endif
@@ -107,7 +107,7 @@ extern "C" {
 
 // CDC buffer sizes
 #define CFG_TUD_CDC_RX_BUFSIZE (256)
-#define CFG_TUD_CDC_TX_BUFSIZE (256)
+#define CFG_TUD_CDC_TX_BUFSIZE (1024)
 
 #ifdef __cplusplus
 }
@@ -9,6 +9,9 @@ __attribute__((format(printf, 1, 2))) void cdc_printf(const char *fmt, ...);
 /** Line print formatted string to USB-CDC output. */
 __attribute__((format(printf, 1, 2))) void cdc_printfln(const char *fmt, ...);
 
+/** Initialise USB-CDC output, before the scheduler is started. */
+void cdc_init(void);
+
 void cdc_log(const char *str);
 void cdc_task(void *param);
 
@@ -25,6 +25,14 @@
 #ifndef USB_DESCRIPTORS_H_
 #define USB_DESCRIPTORS_H_
 
+#include <stdint.h>
+
 enum { REPORT_ID_KEYBOARD = 1, REPORT_ID_COUNT };
 
+/** Set the HID polling interval, takes effect on the next enumeration. */
+void usb_descriptors_set_hid_interval(uint8_t interval_ms);
+
+/** Get the HID polling interval as advertised to the host. */
+uint8_t usb_descriptors_get_hid_interval(void);
+
 #endif /* USB_DESCRIPTORS_H_ */
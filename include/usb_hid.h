@@ -1,7 +1,51 @@
 #ifndef USB_HID_H
 #define USB_HID_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* @todo need atomics for thread sync safety */
+typedef struct {
+  /** Reports submitted to the HID endpoint. */
+  uint32_t reports;
+  /** Report submit to host collection latency. */
+  uint32_t latency_min_us;
+  uint32_t latency_max_us;
+  /** Host poll intervals sampled in measurement mode. */
+  uint32_t poll_samples;
+  uint32_t poll_min_us;
+  uint32_t poll_max_us;
+  uint64_t poll_total_us;
+  /** Keys sent to the HID queue. */
+  uint32_t keys_queued;
+  /** Repeated keys merged with the pending key. */
+  uint32_t keys_coalesced;
+  /** Keys dropped due to a full HID queue. */
+  uint32_t keys_dropped;
+} usb_hid_stats_t;
+
 void usb_task(void *param);
 void hid_task(void *param);
 
+void usb_hid_get_stats(usb_hid_stats_t *stats);
+
+/**
+ * Send a key, or HID_KEY_NONE for a release, to the HID task without blocking.
+ *
+ * Repeats of the pending key are merged and the oldest key dropped if the
+ * queue is full.
+ */
+void usb_hid_send_key(uint8_t key);
+
+/**
+ * Start measuring the host poll cadence.
+ *
+ * Back-to-back empty reports are sent, each completing on a host poll.
+ */
+bool usb_hid_measure_start(void);
+bool usb_hid_measure_running(void);
+
+/** Abort a running macro, releasing its keys, eg. once the macros change. */
+void usb_hid_macro_cancel(void);
+
 #endif
@@ -1,8 +1,16 @@
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "class/hid/hid.h"
 #include "tusb.h"
 
+#include "pico/platform.h"
+
 #include "cec-config.h"
 #include "cec-user.h"
+#include "nvs.h"
 
 /**
  * Default EDID probe delay in milliseconds.
@@ -36,10 +44,18 @@ static const uint8_t default_logical_addr = 0x0f;
  */
 static const uint8_t default_device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
 
+/**
+ * Default HID polling interval in milliseconds.
+ *
+ * The interval the host is requested to poll the HID endpoint, valid values
+ * are 1 to 255 for a full-speed device.
+ */
+static const uint8_t default_hid_interval_ms = 5;
+
 /**
  * Default (Kodi) key mapping from CEC user control to HID keyboard entry.
  */
-static const uint8_t default_kodi_user_keymap[UINT8_MAX] = {
+static const uint8_t __in_flash("keymap") default_kodi_user_keymap[UINT8_MAX] = {
     [CEC_USER_SELECT] = HID_KEY_ENTER,
     [CEC_USER_UP] = HID_KEY_ARROW_UP,
     [CEC_USER_DOWN] = HID_KEY_ARROW_DOWN,
@@ -70,7 +86,7 @@ static const uint8_t default_kodi_user_keymap[UINT8_MAX] = {
 /**
  * Key mapping for MiSTer integration, from LaserBearIndustries.
  */
-static const uint8_t default_mister_user_keymap[UINT8_MAX] = {
+static const uint8_t __in_flash("keymap") default_mister_user_keymap[UINT8_MAX] = {
     [CEC_USER_SELECT] = HID_KEY_ENTER,
     [CEC_USER_UP] = HID_KEY_ARROW_UP,
     [CEC_USER_DOWN] = HID_KEY_ARROW_DOWN,
@@ -97,6 +113,15 @@ static const uint8_t default_mister_user_keymap[UINT8_MAX] = {
     [CEC_USER_SUB_PICTURE] = HID_KEY_L,
     0x00};
 
+/** Live configuration, only written by cec_config_set(). */
+static cec_config_t live;
+
+/** Live macros, only written by cec_config_set_macro(). */
+static uint8_t live_macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+/** Seqlock sequence, odd while live is being written. */
+static uint32_t live_seq = 0;
+
 void cec_config_set_default(cec_config_t *config) {
   if (config == NULL) {
     return;
@@ -105,6 +130,8 @@ void cec_config_set_default(cec_config_t *config) {
   config->physical_address = default_physical_addr;
   config->logical_address = default_logical_addr;
   config->device_type = default_device_type;
+  config->hid_interval_ms = default_hid_interval_ms;
+  config->audio_system = false;
 #if KEYMAP_DEFAULT_KODI
   config->keymap_type = CEC_CONFIG_KEYMAP_KODI;
 #elif KEYMAP_DEFAULT_MISTER
@@ -122,8 +149,6 @@ void cec_config_set_keymap(cec_config_t *config) {
   const uint8_t *default_keymap = NULL;
 
   switch (config->keymap_type) {
-    case CEC_CONFIG_KEYMAP_CUSTOM:
-      break;
     case CEC_CONFIG_KEYMAP_KODI:
       default_keymap = &default_kodi_user_keymap[0];
       break;
@@ -134,17 +159,103 @@ void cec_config_set_keymap(cec_config_t *config) {
       return;
   }
 
-  // set only the keys, keynames are finalised in cec_config_complete()
-  for (unsigned int i = 0; i < UINT8_MAX; i++) {
-    config->keymap[i].key = default_keymap[i];
+  memcpy(config->keymap, default_keymap, sizeof(config->keymap));
+}
+
+void cec_config_init(void) {
+  nvs_load_config(&live);
+  nvs_read_macros(live_macros);
+  __atomic_store_n(&live_seq, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Start a seqlock read, waiting out any write in progress.
+ *
+ * The writer suspends the scheduler, so a task never observes an odd
+ * sequence and this does not spin in practice.
+ */
+static uint32_t read_begin(void) {
+  uint32_t seq;
+
+  while ((seq = __atomic_load_n(&live_seq, __ATOMIC_ACQUIRE)) & 1) {
+    // write in progress
   }
+
+  return seq;
+}
+
+/**
+ * Finish a seqlock read, returns true if it overlapped a write.
+ */
+static bool read_retry(uint32_t seq) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&live_seq, __ATOMIC_RELAXED) != seq;
 }
 
-void cec_config_complete(cec_config_t *config) {
-  for (uint8_t i = 0; i < UINT8_MAX; i++) {
-    if (config->keymap[i].key != 0x00) {
-      const char *name = cec_user_control_name[i];
-      config->keymap[i].name = name;
-    }
+uint32_t cec_config_get(cec_config_t *config) {
+  uint32_t seq;
+
+  do {
+    seq = read_begin();
+    memcpy(config, &live, sizeof(*config));
+  } while (read_retry(seq));
+
+  return seq;
+}
+
+bool cec_config_get_macro(uint8_t index, uint8_t code[HID_MACRO_LENGTH]) {
+  if (index >= HID_MACRO_COUNT) {
+    return false;
+  }
+
+  uint32_t seq;
+  do {
+    seq = read_begin();
+    memcpy(code, live_macros[index], HID_MACRO_LENGTH);
+  } while (read_retry(seq));
+
+  return true;
+}
+
+uint32_t cec_config_version(void) {
+  return __atomic_load_n(&live_seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Start a seqlock write, readers retry until write_end().
+ */
+static void write_begin(void) {
+  vTaskSuspendAll();
+
+  __atomic_store_n(&live_seq, live_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(void) {
+  __atomic_store_n(&live_seq, live_seq + 1, __ATOMIC_RELEASE);
+
+  xTaskResumeAll();
+}
+
+void cec_config_set(const cec_config_t *config) {
+  write_begin();
+  memcpy(&live, config, sizeof(live));
+  write_end();
+}
+
+bool cec_config_set_macro(uint8_t index, const uint8_t code[HID_MACRO_LENGTH]) {
+  if (index >= HID_MACRO_COUNT) {
+    return false;
   }
+
+  write_begin();
+  memcpy(live_macros[index], code, HID_MACRO_LENGTH);
+  write_end();
+
+  return true;
+}
+
+bool cec_config_save_macros(void) {
+  // the CLI is the only writer, and the only caller
+  return nvs_save_macros(live_macros);
 }
@@ -3,9 +3,11 @@
 #include <string.h>
 
 #include "FreeRTOS.h"
-#include "message_buffer.h"
 #include "task.h"
 
+#include "hardware/sync.h"
+#include "pico/platform.h"
+
 #include "pico-cec/config.h"
 #include "pico-cec/util.h"
 
@@ -15,60 +17,200 @@
 #include "cec-user.h"
 
 #define LOG_LINE_LENGTH (64)
+
+/** Number of log lines, must be a power of 2. */
 #define LOG_QUEUE_LENGTH (16)
-#define LOG_MB_SIZE (LOG_LINE_LENGTH * LOG_QUEUE_LENGTH)
+
+/** Number of frame records, must be a power of 2. */
+#define LOG_FRAME_RING_LENGTH (16)
+
+/** Record type of a frame, after the events. */
+#define LOG_RECORD_FRAME (CEC_LOG_EVENT_MAX)
+
+/**
+ * Raw CEC frame or event record, captured in cec_task or the CEC interrupt
+ * and decoded in the log task.
+ */
+typedef struct {
+  uint64_t timestamp_ms;
+  /** An event (cec_log_event_t) or LOG_RECORD_FRAME. */
+  uint8_t type;
+  union {
+    struct {
+      bool recv;
+      bool ack;
+      uint8_t len;
+      uint8_t data[16];
+    };
+    uint32_t args[CEC_LOG_EVENT_ARGS];
+  };
+} cec_log_record_t;
 
 static StaticTask_t log_task_static;
 static StackType_t log_stack[LOG_STACK_SIZE];
+static TaskHandle_t xLogTask;
 
-static StaticMessageBuffer_t log_mb_static;
-static MessageBufferHandle_t log_mb;
-static uint8_t log_mb_storage[LOG_MB_SIZE];
+/**
+ * Multiple producer, single consumer (log task) line ring.
+ *
+ * Producers may run in any task, slots are claimed with interrupts disabled.
+ * Indices are free running.
+ */
+static char line_ring[LOG_QUEUE_LENGTH][LOG_LINE_LENGTH];
+static uint32_t line_head;
+static uint32_t line_tail;
 
-static volatile bool enabled = false;
+/* Updated with interrupts disabled, see cec_log_get_stats(). */
+static cec_log_stats_t log_stats;
 
-static void cec_log_task(void *param) {
-  log_callback_t log = param;
+/**
+ * Frame and event ring, filled by the cec tasks (one per bus) and the CEC
+ * interrupt, and drained by the log task.
+ *
+ * Producers fill and publish a record with interrupts disabled, it is only a
+ * short copy. Indices are free running, only producers write head and only
+ * the consumer writes tail.
+ */
+static cec_log_record_t frame_ring[LOG_FRAME_RING_LENGTH];
+static uint32_t frame_head;
+static uint32_t frame_tail;
+
+static log_callback_t log_cb;
+
+volatile uint32_t cec_log_modules = 0;
+
+static const char *const module_names[CEC_LOG_MODULE_MAX] = {
+    [CEC_LOG_PHY] = "phy",
+    [CEC_LOG_PROTOCOL] = "protocol",
+    [CEC_LOG_DDC] = "ddc",
+    [CEC_LOG_NVS] = "nvs",
+    [CEC_LOG_USB] = "usb",
+};
+
+/**
+ * Event line formats, each argument is passed as an unsigned long.
+ */
+static const char *const event_formats[CEC_LOG_EVENT_MAX] = {
+    [CEC_LOG_EVENT_RX_START_LOW] = "rx abort: start bit low %lu us",
+    [CEC_LOG_EVENT_RX_START_PERIOD] = "rx abort: start bit period %lu us, byte %lu bit %lu",
+    [CEC_LOG_EVENT_RX_BIT_PERIOD] = "rx abort: bit period %lu us, byte %lu bit %lu",
+    [CEC_LOG_EVENT_RX_DATA_LOW] = "rx abort: data bit low %lu us, byte %lu bit %lu",
+    [CEC_LOG_EVENT_RX_ACK_LOW] = "rx abort: ack bit low %lu us, byte %lu",
+};
 
+static void log_frame_record(const cec_log_record_t *record);
+static void log_event_record(const cec_log_record_t *record);
+
+static void cec_log_task(void *param) {
   while (true) {
-    char buffer[LOG_LINE_LENGTH];
+    // woken on every submission
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-    size_t bytes = xMessageBufferReceive(log_mb, buffer, sizeof(buffer), pdMS_TO_TICKS(10));
-    if (bytes > 0) {
-      log(buffer);
+    uint32_t head = __atomic_load_n(&frame_head, __ATOMIC_ACQUIRE);
+    while (frame_tail != head) {
+      const cec_log_record_t *record = &frame_ring[frame_tail % LOG_FRAME_RING_LENGTH];
+      if (record->type == LOG_RECORD_FRAME) {
+        log_frame_record(record);
+      } else {
+        log_event_record(record);
+      }
+      __atomic_store_n(&frame_tail, frame_tail + 1, __ATOMIC_RELEASE);
+    }
+
+    head = __atomic_load_n(&line_head, __ATOMIC_ACQUIRE);
+    while (line_tail != head) {
+      log_cb(line_ring[line_tail % LOG_QUEUE_LENGTH]);
+      __atomic_store_n(&line_tail, line_tail + 1, __ATOMIC_RELEASE);
     }
   }
 }
 
 void cec_log_init(log_callback_t log) {
-  log_mb = xMessageBufferCreateStatic(LOG_MB_SIZE, &log_mb_storage[0], &log_mb_static);
-  enabled = false;
+  log_cb = log;
+  cec_log_modules = 0;
+
+  xLogTask = xTaskCreateStatic(cec_log_task, LOG_TASK_NAME, LOG_STACK_SIZE, NULL, LOG_PRIORITY,
+                               &log_stack[0], &log_task_static);
+}
+
+uint32_t cec_log_enabled(void) {
+  return cec_log_modules;
+}
 
-  xTaskCreateStatic(cec_log_task, LOG_TASK_NAME, LOG_STACK_SIZE, log, LOG_PRIORITY, &log_stack[0],
-                    &log_task_static);
+void cec_log_enable(uint32_t mask) {
+  __atomic_fetch_or(&cec_log_modules, mask & CEC_LOG_MODULE_ALL, __ATOMIC_RELAXED);
 }
 
-bool cec_log_enabled(void) {
-  return enabled;
+void cec_log_disable(uint32_t mask) {
+  __atomic_fetch_and(&cec_log_modules, ~mask, __ATOMIC_RELAXED);
 }
 
-void cec_log_enable(void) {
-  enabled = true;
+const char *cec_log_module_name(cec_log_module_t module) {
+  return module < CEC_LOG_MODULE_MAX ? module_names[module] : NULL;
 }
 
-void cec_log_disable(void) {
-  enabled = false;
+void cec_log_get_stats(cec_log_stats_t *stats) {
+  uint32_t irqs = save_and_disable_interrupts();
+  *stats = log_stats;
+  restore_interrupts(irqs);
+}
+
+/**
+ * Wake the log task from either task or interrupt context.
+ */
+static void log_notify(void) {
+  if (__get_current_exception()) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(xLogTask, &woken);
+    portYIELD_FROM_ISR(woken);
+  } else {
+    xTaskNotifyGive(xLogTask);
+  }
 }
 
+/**
+ * Submit a formatted log line.
+ *
+ * Filtering is done by the CEC_LOG_*() macros, this is the common back end.
+ * Never blocks, but formats in place so is not for interrupt context, see
+ * cec_log_event(). Over long lines are truncated, if the ring is full the line
+ * is dropped.
+ */
 void cec_log_vsubmitf(const char *fmt, va_list ap) {
-  if (enabled) {
-    char buffer[LOG_LINE_LENGTH];
+  char buffer[LOG_LINE_LENGTH];
+  bool truncated = false;
 
-    int bytes = vsnprintf(buffer, sizeof(buffer), fmt, ap);
-    if (bytes < sizeof(buffer)) {
-      xMessageBufferSend(log_mb, buffer, bytes + 1, pdMS_TO_TICKS(20));
-    }
+  int bytes = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  if (bytes < 0) {
+    return;
+  } else if (bytes >= sizeof(buffer)) {
+    // keep the line break
+    memcpy(&buffer[sizeof(buffer) - sizeof(_LOG_BR)], _LOG_BR, sizeof(_LOG_BR));
+    bytes = sizeof(buffer) - 1;
+    truncated = true;
+  }
+
+  uint32_t irqs = save_and_disable_interrupts();
+  uint32_t used = line_head - __atomic_load_n(&line_tail, __ATOMIC_ACQUIRE);
+  if (used >= LOG_QUEUE_LENGTH) {
+    log_stats.dropped++;
+    restore_interrupts(irqs);
+    return;
   }
+
+  memcpy(line_ring[line_head % LOG_QUEUE_LENGTH], buffer, bytes + 1);
+  __atomic_store_n(&line_head, line_head + 1, __ATOMIC_RELEASE);
+
+  log_stats.lines++;
+  if (truncated) {
+    log_stats.truncated++;
+  }
+  if (used + 1 > log_stats.high_water) {
+    log_stats.high_water = used + 1;
+  }
+  restore_interrupts(irqs);
+
+  log_notify();
 }
 
 void cec_log_submitf(const char *fmt, ...) {
@@ -79,26 +221,25 @@ void cec_log_submitf(const char *fmt, ...) {
 }
 
 /**
- * Log a timestamped formatted message.
+ * Log a timestamped formatted message for a frame record.
  */
-__attribute__((format(printf, 5, 6))) static void log_printf(uint8_t initiator,
-                                                             uint8_t destination,
-                                                             bool send,
-                                                             bool ack,
+__attribute__((format(printf, 2, 3))) static void log_printf(const cec_log_record_t *record,
                                                              const char *fmt,
                                                              ...) {
-  char prefix[64];
-  char buffer[64];
+  char line[2 * LOG_LINE_LENGTH];
+  uint8_t initiator = (record->data[0] & 0xf0) >> 4;
+  uint8_t destination = record->data[0] & 0x0f;
+  bool send = record->recv;
   char *arrow = "??";
 
   if (send) {
-    if (ack) {
+    if (record->ack) {
       arrow = "->";
     } else {
       arrow = "~>";
     }
   } else {
-    if (ack) {
+    if (record->ack) {
       arrow = "<-";
     } else {
       arrow = "<~";
@@ -107,107 +248,67 @@ __attribute__((format(printf, 5, 6))) static void log_printf(uint8_t initiator,
 
   va_list ap;
   va_start(ap, fmt);
-  snprintf(prefix, sizeof(prefix), "[%10llu] %02x %s %02x", util_uptime_ms(),
-           send ? initiator : destination, arrow, send ? destination : initiator);
-  vsnprintf(buffer, sizeof(buffer), fmt, ap);
-  cec_log_submitf("%s: %s"_LOG_BR, prefix, buffer);
+  int n = snprintf(line, sizeof(line), "[%10llu] %02x %s %02x: ", record->timestamp_ms,
+                   send ? initiator : destination, arrow, send ? destination : initiator);
+  n += vsnprintf(&line[n], sizeof(line) - n, fmt, ap);
   va_end(ap);
+  if (n < sizeof(line)) {
+    snprintf(&line[n], sizeof(line) - n, "%s", _LOG_BR);
+  }
+  log_cb(line);
 }
 
-const char *cec_message[] = {
-    [CEC_ID_FEATURE_ABORT] = "Feature Abort",
-    [CEC_ID_IMAGE_VIEW_ON] = "Image View On",
-    [CEC_ID_TEXT_VIEW_ON] = "Text View On",
-    [CEC_ID_STANDBY] = "Standby",
-    [CEC_ID_USER_CONTROL_PRESSED] = "User Control Pressed",
-    [CEC_ID_USER_CONTROL_RELEASED] = "User Control Released",
-    [CEC_ID_GIVE_OSD_NAME] = "Give OSD Name",
-    [CEC_ID_SET_OSD_NAME] = "Set OSD Name",
-    [CEC_ID_SYSTEM_AUDIO_MODE_REQUEST] = "System Audio Mode Request",
-    [CEC_ID_GIVE_AUDIO_STATUS] = "Give Audio Status",
-    [CEC_ID_SET_SYSTEM_AUDIO_MODE] = "Set System Audio Mode",
-    [CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS] = "Give System Audio Mode",
-    [CEC_ID_SYSTEM_AUDIO_MODE_STATUS] = "System Audio Mode Status",
-    [CEC_ID_REPORT_AUDIO_STATUS] = "Report Audio Status",
-    [CEC_ID_ROUTING_CHANGE] = "Routing Change",
-    [CEC_ID_ACTIVE_SOURCE] = "Active Source",
-    [CEC_ID_GIVE_PHYSICAL_ADDRESS] = "Give Physical Address",
-    [CEC_ID_REPORT_PHYSICAL_ADDRESS] = "Report Physical Address",
-    [CEC_ID_REQUEST_ACTIVE_SOURCE] = "Request Active Source",
-    [CEC_ID_SET_STREAM_PATH] = "Set Stream Path",
-    [CEC_ID_DEVICE_VENDOR_ID] = "Device Vendor ID",
-    [CEC_ID_GIVE_DEVICE_VENDOR_ID] = "Give Device Vendor ID",
-    [CEC_ID_MENU_STATUS] = "Menu Status",
-    [CEC_ID_MENU_REQUEST] = "Menu Request",
-    [CEC_ID_GIVE_DEVICE_POWER_STATUS] = "Give Device Power Status",
-    [CEC_ID_REPORT_POWER_STATUS] = "Report Power Status",
-    [CEC_ID_GET_MENU_LANGUAGE] = "Get Menu Language",
-    [CEC_ID_INACTIVE_SOURCE] = "Inactive Source",
-    [CEC_ID_CEC_VERSION] = "CEC Version",
-    [CEC_ID_GET_CEC_VERSION] = "Get CEC Version",
-    [CEC_ID_VENDOR_COMMAND_WITH_ID] = "Vendor Command With ID",
-    [CEC_ID_REQUEST_ARC_INITIATION] = "Request ARC Initiation",
-    [CEC_ID_ABORT] = "Abort",
-};
+UTIL_NAME_TABLE(cec_message, CEC_MESSAGE_NAMES);
 
-const char *cec_feature_abort_reason[] = {
-    [CEC_ABORT_UNRECOGNIZED] = "Unrecognized opcode",
-    [CEC_ABORT_INCORRECT_MODE] = "Not in correct mode to respond",
-    [CEC_ABORT_NO_SOURCE] = "Cannot provide source",
-    [CEC_ABORT_INVALID] = "Invalid operand",
-    [CEC_ABORT_REFUSED] = "Refused",
-    [CEC_ABORT_UNDETERMINED] = "Undetermined",
-};
+UTIL_NAME_TABLE(cec_feature_abort, CEC_FEATURE_ABORT_NAMES);
 
 /**
- * Log a CEC frame.
+ * Log a CEC frame record.
  *
  * CEC frame logging function, which includes minor protocol decoding for debug
- * purposes.
+ * purposes. Runs in the log task.
  */
-void cec_log_frame(cec_frame_t *frame, bool recv) {
-  cec_message_t *msg = frame->message;
-  uint8_t initiator = (msg->data[0] & 0xf0) >> 4;
-  uint8_t destination = msg->data[0] & 0x0f;
+static void log_frame_record(const cec_log_record_t *record) {
+  const cec_log_record_t *msg = record;
 
   if (msg->len > 1) {
     uint8_t cmd = msg->data[1];
+    const char *message = UTIL_NAME_FIND(cec_message, cmd);
     switch (cmd) {
-      case CEC_ID_FEATURE_ABORT:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%x][%s]", cec_message[cmd],
-                   msg->data[2], cec_feature_abort_reason[msg->data[3]]);
-        break;
+      case CEC_ID_FEATURE_ABORT: {
+        const char *reason = UTIL_NAME_FIND(cec_feature_abort, msg->data[3]);
+        log_printf(record, "[%s][%x][%s]", message, msg->data[2],
+                   reason != NULL ? reason : "Unknown reason");
+      } break;
       case CEC_ID_STANDBY:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd],
-                   "Display OFF");
+        log_printf(record, "[%s][%s]", message, "Display OFF");
         break;
       case CEC_ID_ROUTING_CHANGE:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%02x%02x -> %02x%02x]",
-                   cec_message[cmd], msg->data[2], msg->data[3], msg->data[4], msg->data[5]);
+        log_printf(record, "[%s][%02x%02x -> %02x%02x]", message, msg->data[2], msg->data[3],
+                   msg->data[4], msg->data[5]);
         break;
       case CEC_ID_ACTIVE_SOURCE:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%02x%02x Display ON]",
-                   cec_message[cmd], msg->data[2], msg->data[3]);
+        log_printf(record, "[%s][%02x%02x Display ON]", message, msg->data[2], msg->data[3]);
         break;
       case CEC_ID_REPORT_PHYSICAL_ADDRESS:
-        log_printf(initiator, destination, recv, frame->ack, "[%s] %02x%02x", cec_message[cmd],
-                   msg->data[2], msg->data[3]);
+        log_printf(record, "[%s] %02x%02x", message, msg->data[2], msg->data[3]);
         break;
       case CEC_ID_USER_CONTROL_PRESSED: {
         uint8_t key = msg->data[2];
-        const char *name = cec_user_control_name[key];
+        const char *name = cec_user_control_name(key);
         if (name != NULL) {
-          log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd], name);
+          log_printf(record, "[%s][%s]", message, name);
         } else {
-          log_printf(initiator, destination, recv, frame->ack, "[%s] Unknown command: 0x%02x",
-                     cec_message[cmd], key);
+          log_printf(record, "[%s] Unknown command: 0x%02x", message, key);
         }
       } break;
       case CEC_ID_VENDOR_COMMAND_WITH_ID:
-        log_printf(initiator, destination, recv, frame->ack, "[%s]", cec_message[cmd]);
+        log_printf(record, "[%s]", message);
+        char hex[(3 * sizeof(msg->data)) + 1] = {0x00};
         for (int i = 0; i < msg->len; i++) {
-          cec_log_submitf(" %02x"_LOG_BR, msg->data[i]);
+          snprintf(&hex[3 * i], 4, " %02x", msg->data[i]);
         }
+        log_printf(record, "%s", hex);
         break;
       case CEC_ID_REPORT_POWER_STATUS:
         const char *status = "unknown";
@@ -225,23 +326,127 @@ void cec_log_frame(cec_frame_t *frame, bool recv) {
             status = "In transition On to Standby";
             break;
         }
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd], status);
+        log_printf(record, "[%s][%s]", message, status);
         break;
       case CEC_ID_MENU_STATUS:
       case CEC_ID_MENU_REQUEST:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%02x]", cec_message[cmd],
-                   msg->data[2]);
+        log_printf(record, "[%s][%02x]", message, msg->data[2]);
         break;
-      default: {
-        const char *message = cec_message[cmd];
-        if (strlen(message) > 0) {
-          log_printf(initiator, destination, recv, frame->ack, "[%s]", cec_message[cmd]);
+      default:
+        if (message != NULL) {
+          log_printf(record, "[%s]", message);
         } else {
-          log_printf(initiator, destination, recv, frame->ack, "[%x] (undecoded)", cmd);
+          log_printf(record, "[%x] (undecoded)", cmd);
         }
-      }
     }
   } else {
-    log_printf(initiator, destination, recv, frame->ack, "[%s]", "Polling Message");
+    log_printf(record, "[%s]", "Polling Message");
+  }
+}
+
+/**
+ * Log an event record, formatted with the arguments captured.
+ */
+static void log_event_record(const cec_log_record_t *record) {
+  char line[LOG_LINE_LENGTH];
+
+  if (record->type >= CEC_LOG_EVENT_MAX) {
+    return;
+  }
+
+  int n = snprintf(line, sizeof(line), event_formats[record->type],
+                   (unsigned long)record->args[0], (unsigned long)record->args[1],
+                   (unsigned long)record->args[2]);
+  if (n < 0) {
+    return;
+  } else if (n > sizeof(line) - sizeof(_LOG_BR)) {
+    // keep the line break
+    n = sizeof(line) - sizeof(_LOG_BR);
+  }
+  memcpy(&line[n], _LOG_BR, sizeof(_LOG_BR));
+  log_cb(line);
+}
+
+/**
+ * Claim the next ring record, called with interrupts disabled.
+ *
+ * Returns NULL if the ring is full. The record is published by
+ * record_publish() once filled in.
+ */
+static cec_log_record_t *record_claim(uint8_t type) {
+  uint32_t tail = __atomic_load_n(&frame_tail, __ATOMIC_ACQUIRE);
+  if ((frame_head - tail) >= LOG_FRAME_RING_LENGTH) {
+    return NULL;
+  }
+
+  cec_log_record_t *record = &frame_ring[frame_head % LOG_FRAME_RING_LENGTH];
+  record->timestamp_ms = util_uptime_ms();
+  record->type = type;
+
+  return record;
+}
+
+static void record_publish(void) {
+  __atomic_store_n(&frame_head, frame_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Capture a CEC frame for logging.
+ *
+ * Called from a cec task, only copies the raw frame, decoding and formatting
+ * is deferred to the log task.
+ */
+void cec_log_frame(cec_frame_t *frame, bool recv) {
+  if ((CEC_LOG_LEVEL < CEC_LOG_LEVEL_INFO) || !cec_log_module_enabled(CEC_LOG_PROTOCOL)) {
+    return;
+  }
+
+  uint32_t irqs = save_and_disable_interrupts();
+
+  cec_log_record_t *record = record_claim(LOG_RECORD_FRAME);
+  if (record == NULL) {
+    log_stats.frames_dropped++;
+    restore_interrupts(irqs);
+    return;
+  }
+
+  record->recv = recv;
+  record->ack = frame->ack;
+  record->len = frame->message->len;
+  if (record->len > sizeof(record->data)) {
+    record->len = sizeof(record->data);
   }
+  memset(record->data, 0, sizeof(record->data));
+  memcpy(record->data, frame->message->data, record->len);
+
+  record_publish();
+  restore_interrupts(irqs);
+
+  xTaskNotifyGive(xLogTask);
+}
+
+/**
+ * Capture an event for logging.
+ *
+ * Filtering is done by the CEC_LOG_EVENT() macros. Never blocks and may be
+ * called from interrupt context, only the arguments are copied. If the ring is
+ * full the event is dropped.
+ */
+void cec_log_event(cec_log_event_t event, const uint32_t args[CEC_LOG_EVENT_ARGS]) {
+  uint32_t irqs = save_and_disable_interrupts();
+
+  cec_log_record_t *record = record_claim(event);
+  if (record == NULL) {
+    log_stats.dropped++;
+    restore_interrupts(irqs);
+    return;
+  }
+
+  memcpy(record->args, args, sizeof(record->args));
+
+  record_publish();
+  log_stats.lines++;
+  restore_interrupts(irqs);
+
+  log_notify();
 }
@@ -1,5 +1,4 @@
 #include "FreeRTOS.h"
-#include "queue.h"
 #include "task.h"
 
 #include "class/hid/hid.h"
@@ -13,7 +12,7 @@
 #include "cec-log.h"
 #include "cec-task.h"
 #include "ddc.h"
-#include "nvs.h"
+#include "usb_hid.h"
 
 /* Intercept HDMI CEC commands, convert to a keypress and send to HID task
  * handler.
@@ -24,8 +23,8 @@
  * https://github.com/tsowell/avr-hdmi-cec-volume/tree/master
  */
 
-/** The running CEC configuration. */
-static cec_config_t config = {0x0};
+/** Longest wait for the first EDID read at boot. */
+#define DDC_BOOT_TIMEOUT_MS (1000)
 
 // HDMI logical addresses
 // 2 dimensional array of valid logical addresses for playback and recording
@@ -41,117 +40,149 @@ static const uint8_t laddress[NUM_TYPES][NUM_LADDRESS] = {
     {0x05, 0x05, 0x05, 0x05},  // Audio System
 };
 
-/* The HDMI address for this device.  Respond to CEC sent to this address. */
-static uint8_t laddr = 0x0f;
-
-/* The HDMI physical address. */
-static uint16_t paddr = 0x0000;
-
-/* Active state. */
-static uint16_t active_addr = 0x0000;
-
-/* Audio state. */
-static bool audio_status = false;
+/**
+ * Protocol state of a CEC bus, each bus is served by its own cec_task.
+ */
+typedef struct {
+  cec_bus_t *bus;
+  /** Physical address from EDID, only the first bus is wired to DDC. */
+  bool ddc;
+  /** Snapshot of the live CEC configuration. */
+  cec_config_t config;
+  /** Version of the live configuration in the snapshot. */
+  uint32_t config_version;
+  /* The HDMI address for this device.  Respond to CEC sent to this address. */
+  uint8_t laddr;
+  /* The HDMI physical address. */
+  uint16_t paddr;
+  /* Active state. */
+  uint16_t active_addr;
+  /* Audio state. */
+  bool audio_status;
+  /* Audio system logical address, 0x0f if not emulated. */
+  uint8_t audio_laddr;
+  /* Logical addresses acknowledged on the bus, bit n for address n. */
+  uint16_t addresses;
+} cec_device_t;
+
+static cec_device_t devices[CEC_BUS_COUNT];
 
 /* Construct the frame address header. */
 #define HEADER0(iaddr, daddr) ((iaddr << 4) | daddr)
 
-static void cec_feature_abort(uint8_t initiator,
+static void cec_feature_abort(cec_bus_t *bus,
+                              uint8_t initiator,
                               uint8_t destination,
                               uint8_t msg,
                               cec_abort_t reason) {
   uint8_t pld[4] = {HEADER0(initiator, destination), CEC_ID_FEATURE_ABORT, msg, reason};
 
-  cec_frame_send(4, pld);
+  cec_frame_send(bus, 4, pld);
 }
 
-static void device_vendor_id(uint8_t initiator, uint8_t destination, uint32_t vendor_id) {
+static void device_vendor_id(cec_bus_t *bus,
+                             uint8_t initiator,
+                             uint8_t destination,
+                             uint32_t vendor_id) {
   uint8_t pld[5] = {HEADER0(initiator, destination), CEC_ID_DEVICE_VENDOR_ID,
                     (vendor_id >> 16) & 0x0ff, (vendor_id >> 8) & 0x0ff, (vendor_id >> 0) & 0x0ff};
 
-  cec_frame_send(5, pld);
+  cec_frame_send(bus, 5, pld);
 }
 
-static void report_power_status(uint8_t initiator, uint8_t destination, uint8_t power_status) {
+static void report_power_status(cec_bus_t *bus,
+                                uint8_t initiator,
+                                uint8_t destination,
+                                uint8_t power_status) {
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_REPORT_POWER_STATUS, power_status};
 
-  cec_frame_send(3, pld);
+  cec_frame_send(bus, 3, pld);
 }
 
-static void set_system_audio_mode(uint8_t initiator,
+static void set_system_audio_mode(cec_bus_t *bus,
+                                  uint8_t initiator,
                                   uint8_t destination,
                                   uint8_t system_audio_mode) {
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_SET_SYSTEM_AUDIO_MODE,
                     system_audio_mode};
 
-  cec_frame_send(3, pld);
+  cec_frame_send(bus, 3, pld);
 }
 
-static void report_audio_status(uint8_t initiator, uint8_t destination, uint8_t audio_status) {
+static void report_audio_status(cec_bus_t *bus,
+                                uint8_t initiator,
+                                uint8_t destination,
+                                uint8_t audio_status) {
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_REPORT_AUDIO_STATUS, audio_status};
 
-  cec_frame_send(3, pld);
+  cec_frame_send(bus, 3, pld);
 }
 
-static void system_audio_mode_status(uint8_t initiator,
+static void system_audio_mode_status(cec_bus_t *bus,
+                                     uint8_t initiator,
                                      uint8_t destination,
                                      uint8_t system_audio_mode_status) {
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_SYSTEM_AUDIO_MODE_STATUS,
                     system_audio_mode_status};
 
-  cec_frame_send(3, pld);
+  cec_frame_send(bus, 3, pld);
 }
 
-static void set_osd_name(uint8_t initiator, uint8_t destination) {
+static void set_osd_name(cec_bus_t *bus, uint8_t initiator, uint8_t destination) {
   uint8_t pld[10] = {
       HEADER0(initiator, destination), CEC_ID_SET_OSD_NAME, 'P', 'i', 'c', 'o', '-', 'C', 'E', 'C'};
 
-  cec_frame_send(10, pld);
+  cec_frame_send(bus, 10, pld);
 }
 
-static void report_physical_address(uint8_t initiator,
+static void report_physical_address(cec_bus_t *bus,
+                                    uint8_t initiator,
                                     uint8_t destination,
                                     uint16_t physical_address,
                                     uint8_t device_type) {
   uint8_t pld[5] = {HEADER0(initiator, destination), CEC_ID_REPORT_PHYSICAL_ADDRESS,
                     (physical_address >> 8) & 0x0ff, (physical_address >> 0) & 0x0ff, device_type};
 
-  cec_frame_send(5, pld);
+  cec_frame_send(bus, 5, pld);
 }
 
-static void report_cec_version(uint8_t initiator, uint8_t destination) {
+static void report_cec_version(cec_bus_t *bus, uint8_t initiator, uint8_t destination) {
   // 0x04 = 1.3a
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_CEC_VERSION, 0x04};
-  cec_frame_send(3, pld);
+  cec_frame_send(bus, 3, pld);
 }
 
-bool cec_ping(uint8_t destination) {
+static bool cec_ping(cec_bus_t *bus, uint8_t destination) {
   uint8_t pld[1] = {HEADER0(destination, destination)};
 
-  return cec_frame_send(1, pld);
+  return cec_frame_send(bus, 1, pld);
 }
 
-static void image_view_on(uint8_t initiator, uint8_t destination) {
+static void image_view_on(cec_bus_t *bus, uint8_t initiator, uint8_t destination) {
   uint8_t pld[2] = {HEADER0(initiator, destination), CEC_ID_IMAGE_VIEW_ON};
 
-  cec_frame_send(2, pld);
+  cec_frame_send(bus, 2, pld);
 }
 
-static void active_source(uint8_t initiator, uint16_t physical_address) {
+static void active_source(cec_bus_t *bus, uint8_t initiator, uint16_t physical_address) {
   uint8_t pld[4] = {HEADER0(initiator, 0x0f), CEC_ID_ACTIVE_SOURCE, (physical_address >> 8) & 0x0ff,
                     (physical_address >> 0) & 0x0ff};
 
-  cec_frame_send(4, pld);
+  cec_frame_send(bus, 4, pld);
 }
 
-static void menu_status(uint8_t initiator, uint8_t destination, bool menu_state) {
+static void menu_status(cec_bus_t *bus,
+                        uint8_t initiator,
+                        uint8_t destination,
+                        bool menu_state) {
   uint8_t state = menu_state ? (uint8_t)CEC_MENU_ACTIVATE : (uint8_t)CEC_MENU_DEACTIVATE;
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_MENU_STATUS, state};
 
-  cec_frame_send(sizeof(pld), pld);
+  cec_frame_send(bus, sizeof(pld), pld);
 }
 
-static uint8_t allocate_logical_address(cec_config_t *config) {
+static uint8_t allocate_logical_address(cec_device_t *dev) {
+  const cec_config_t *config = &dev->config;
   if (config->logical_address != 0x00 && config->logical_address != 0x0f) {
     return config->logical_address;
   }
@@ -160,54 +191,200 @@ static uint8_t allocate_logical_address(cec_config_t *config) {
   uint8_t a;
   for (unsigned int i = 0; i < NUM_LADDRESS; i++) {
     a = laddress[config->device_type][i];
-    cec_log_submitf("Attempting to allocate logical address 0x%01hhx"_LOG_BR, a);
-    if (!cec_ping(a)) {
+    CEC_LOG_INFO(CEC_LOG_PROTOCOL, "Attempting to allocate logical address 0x%01hhx", a);
+    if (!cec_ping(dev->bus, a)) {
       break;
     }
   }
 
-  cec_log_submitf("Allocated logical address 0x%02x"_LOG_BR, a);
+  CEC_LOG_INFO(CEC_LOG_PROTOCOL, "Allocated logical address 0x%02x", a);
   return a;
 }
 
-uint16_t get_physical_address(const cec_config_t *config) {
-  return (config->physical_address == 0x0000) ? ddc_get_physical_address()
-                                              : config->physical_address;
+/**
+ * Audio system logical address, claimed alongside the configured device type
+ * unless another device already answers on it.
+ */
+static uint8_t allocate_audio_address(cec_device_t *dev) {
+  const cec_config_t *config = &dev->config;
+  if (config->device_type == CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM) {
+    return dev->laddr;
+  }
+  if (!config->audio_system) {
+    return 0x0f;
+  }
+
+  uint8_t a = laddress[CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM][0];
+  if (cec_ping(dev->bus, a)) {
+    CEC_LOG_WARN(CEC_LOG_PROTOCOL, "Audio system address 0x%02x already in use", a);
+    return 0x0f;
+  }
+
+  CEC_LOG_INFO(CEC_LOG_PROTOCOL, "Allocated audio system address 0x%02x", a);
+  return a;
 }
 
-uint16_t cec_get_physical_address(void) {
-  return paddr;
+/**
+ * Allocate every logical address emulated on the bus, the PHY acknowledges
+ * frames to any of them.
+ */
+static void allocate_logical_addresses(cec_device_t *dev) {
+  dev->laddr = allocate_logical_address(dev);
+  dev->audio_laddr = allocate_audio_address(dev);
+
+  dev->addresses = 0x0000;
+  if (dev->laddr != 0x0f) {
+    dev->addresses |= 1 << dev->laddr;
+  }
+  if (dev->audio_laddr != 0x0f) {
+    dev->addresses |= 1 << dev->audio_laddr;
+  }
 }
 
-uint8_t cec_get_logical_address(void) {
-  return laddr;
+/**
+ * Check if a frame is directed to one of our logical addresses.
+ */
+static bool claimed(const cec_device_t *dev, uint8_t destination) {
+  return (destination != 0x0f) && (dev->addresses & (1 << destination));
 }
 
-void cec_task(void *param) {
-  QueueHandle_t *q = (QueueHandle_t *)param;
+/**
+ * Device type answering on a logical address.
+ */
+static uint8_t device_type(const cec_device_t *dev, uint8_t address) {
+  return (address == dev->audio_laddr) ? (uint8_t)CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM
+                                       : dev->config.device_type;
+}
 
-  /* Menu state. */
-  bool menu_state = false;
+/**
+ * Broadcast the physical address from each of our logical addresses.
+ */
+static void announce(const cec_device_t *dev) {
+  if (dev->paddr == 0x0000) {
+    return;
+  }
 
-  // load configuration
-  nvs_load_config(&config);
+  report_physical_address(dev->bus, dev->laddr, 0x0f, dev->paddr, dev->config.device_type);
+  if (dev->audio_laddr != 0x0f && dev->audio_laddr != dev->laddr) {
+    report_physical_address(dev->bus, dev->audio_laddr, 0x0f, dev->paddr,
+                            CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM);
+  }
+}
 
-  // pause for EDID to settle
-  vTaskDelay(pdMS_TO_TICKS(config.edid_delay_ms));
+/**
+ * Configured physical address, or the one from the last EDID read.
+ *
+ * Only the first bus has DDC, the others have no physical address unless it
+ * is configured.
+ */
+static uint16_t get_physical_address(const cec_device_t *dev) {
+  if (dev->config.physical_address != 0x0000) {
+    return dev->config.physical_address;
+  }
 
-  cec_frame_init();
+  return dev->ddc ? ddc_get_physical_address() : 0x0000;
+}
 
-  paddr = get_physical_address(&config);
-  laddr = allocate_logical_address(&config);
+/**
+ * Request a new EDID read in the background, if the physical address comes
+ * from EDID. The ddc task wakes us if the result changed.
+ */
+static void refresh_physical_address(const cec_device_t *dev) {
+  if (dev->ddc && dev->config.physical_address == 0x0000) {
+    ddc_refresh();
+  }
+}
+
+uint16_t cec_get_physical_address(unsigned int bus) {
+  return devices[bus].paddr;
+}
+
+uint8_t cec_get_logical_address(unsigned int bus) {
+  return devices[bus].laddr;
+}
+
+uint16_t cec_get_logical_addresses(unsigned int bus) {
+  return devices[bus].addresses;
+}
+
+/**
+ * Refresh the configuration snapshot if the live configuration changed.
+ *
+ * Returns true if the addressing (physical/logical address, device type)
+ * changed.
+ */
+static bool config_refresh(cec_device_t *dev) {
+  cec_config_t *config = &dev->config;
+  if (cec_config_version() == dev->config_version) {
+    return false;
+  }
+
+  uint16_t physical_address = config->physical_address;
+  uint8_t logical_address = config->logical_address;
+  uint8_t device_type = config->device_type;
+
+  dev->config_version = cec_config_get(config);
+
+  return (config->physical_address != physical_address) ||
+         (config->logical_address != logical_address) || (config->device_type != device_type);
+}
+
+void cec_task(void *param) {
+  const cec_task_param_t *task = (const cec_task_param_t *)param;
+  cec_device_t *dev = &devices[task->bus];
+  cec_bus_t *bus = cec_frame_bus(task->bus);
+
+  /* Menu state. */
+  bool menu_state = false;
+
+  dev->bus = bus;
+  dev->ddc = (task->bus == 0);
+  dev->laddr = 0x0f;
+  dev->audio_laddr = 0x0f;
+
+  // snapshot the live configuration
+  dev->config_version = cec_config_get(&dev->config);
+
+  if (dev->ddc && dev->config.physical_address == 0x0000 && ddc_has_cached_address()) {
+    // start with the last sink's address, confirmed once EDID has settled
+    cec_frame_init(bus);
+    ddc_confirm_delayed(pdMS_TO_TICKS(dev->config.edid_delay_ms));
+  } else {
+    // pause for EDID to settle
+    vTaskDelay(pdMS_TO_TICKS(dev->config.edid_delay_ms));
+
+    cec_frame_init(bus);
+
+    if (dev->ddc && dev->config.physical_address == 0x0000) {
+      ddc_result_t result = ddc_refresh_wait(pdMS_TO_TICKS(DDC_BOOT_TIMEOUT_MS));
+      if (result == DDC_RESULT_TIMEOUT) {
+        CEC_LOG_WARN(CEC_LOG_DDC, "EDID read still in progress");
+      } else if (result == DDC_RESULT_FAILED) {
+        CEC_LOG_WARN(CEC_LOG_DDC, "EDID read failed, no physical address yet");
+      }
+    }
+  }
+  dev->paddr = get_physical_address(dev);
+  allocate_logical_addresses(dev);
 
   while (true) {
     uint8_t pld[16] = {0x0};
     uint8_t pldcnt;
     uint8_t initiator, destination;
-    uint8_t key = HID_KEY_NONE;
     uint8_t no_active = 0;
 
-    pldcnt = cec_frame_recv(pld, laddr);
+    pldcnt = cec_frame_recv(bus, pld, dev->addresses);
+
+    if (config_refresh(dev)) {
+      // addressing changed, re-announce ourselves
+      dev->paddr = get_physical_address(dev);
+      allocate_logical_addresses(dev);
+      announce(dev);
+    } else if (get_physical_address(dev) != dev->paddr) {
+      // a background EDID read found a new physical address
+      dev->paddr = get_physical_address(dev);
+      announce(dev);
+    }
     // printf("pldcnt = %u\n", pldcnt);
     initiator = (pld[0] & 0xf0) >> 4;
     destination = pld[0] & 0x0f;
@@ -219,72 +396,86 @@ void cec_task(void *param) {
         case CEC_ID_TEXT_VIEW_ON:
           break;
         case CEC_ID_STANDBY:
-          if (destination == laddr || destination == 0x0f) {
-            active_addr = 0x0000;
+          if (claimed(dev, destination) || destination == 0x0f) {
+            dev->active_addr = 0x0000;
             blink_set_blink(BLINK_STATE_BLUE_2HZ);
           }
           break;
         case CEC_ID_SYSTEM_AUDIO_MODE_REQUEST:
-          if (destination == laddr) {
-            set_system_audio_mode(laddr, initiator, audio_status);
+          // audio system opcodes, only answered from the audio system address
+          if (destination == dev->audio_laddr) {
+            set_system_audio_mode(bus, destination, initiator, dev->audio_status);
+          } else if (claimed(dev, destination)) {
+            cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
           }
           break;
         case CEC_ID_GIVE_AUDIO_STATUS:
-          if (destination == laddr) {
-            report_audio_status(laddr, initiator, 0x32);  // volume 50%, mute off
+          if (destination == dev->audio_laddr) {
+            edid_info_t info;
+            if (dev->ddc && ddc_get_info(&info) && !edid_has_audio(&info)) {
+              // the sink's EDID says it cannot play audio at all
+              cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_INCORRECT_MODE);
+            } else {
+              report_audio_status(bus, destination, initiator, 0x32);  // volume 50%, mute off
+            }
+          } else if (claimed(dev, destination)) {
+            cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
           }
           break;
         case CEC_ID_SET_SYSTEM_AUDIO_MODE:
-          if (destination == laddr || destination == 0x0f) {
-            audio_status = (pld[2] == 1);
+          if (claimed(dev, destination) || destination == 0x0f) {
+            dev->audio_status = (pld[2] == 1);
           }
           break;
         case CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS:
-          if (destination == laddr)
-            system_audio_mode_status(laddr, initiator, audio_status);
+          if (destination == dev->audio_laddr) {
+            system_audio_mode_status(bus, destination, initiator, dev->audio_status);
+          } else if (claimed(dev, destination)) {
+            cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+          }
           break;
         case CEC_ID_SYSTEM_AUDIO_MODE_STATUS:
           break;
         case CEC_ID_ROUTING_CHANGE:
           // uint16_t old_addr = (pld[2] << 8) | pld[3];
-          active_addr = (pld[4] << 8) | pld[5];
-          paddr = get_physical_address(&config);
-          laddr = allocate_logical_address(&config);
-          if (paddr == active_addr) {
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
+          dev->active_addr = (pld[4] << 8) | pld[5];
+          refresh_physical_address(dev);
+          dev->paddr = get_physical_address(dev);
+          allocate_logical_addresses(dev);
+          if (dev->paddr == dev->active_addr) {
+            image_view_on(bus, dev->laddr, 0x00);
+            active_source(bus, dev->laddr, dev->paddr);
             no_active = 0;
           }
           break;
         case CEC_ID_ACTIVE_SOURCE:
-          active_addr = (pld[2] << 8) | pld[3];
+          dev->active_addr = (pld[2] << 8) | pld[3];
           no_active = 0;
           break;
         case CEC_ID_REPORT_PHYSICAL_ADDRESS:
           // On broadcast receive, do the same
           if ((initiator == 0x00) && (destination == 0x0f)) {
-            paddr = get_physical_address(&config);
-            laddr = allocate_logical_address(&config);
-            if (paddr != 0x0000) {
-              report_physical_address(laddr, 0x0f, paddr, config.device_type);
-            }
+            refresh_physical_address(dev);
+            dev->paddr = get_physical_address(dev);
+            allocate_logical_addresses(dev);
+            announce(dev);
           }
           break;
         case CEC_ID_REQUEST_ACTIVE_SOURCE:
           no_active++;
-          if (paddr == active_addr || no_active > 2) {
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
+          if (dev->paddr == dev->active_addr || no_active > 2) {
+            image_view_on(bus, dev->laddr, 0x00);
+            active_source(bus, dev->laddr, dev->paddr);
             no_active = 0;
           }
           break;
         case CEC_ID_SET_STREAM_PATH:
-          if (paddr == ((pld[2] << 8) | pld[3])) {
-            active_addr = paddr;
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
+          if (dev->paddr == ((pld[2] << 8) | pld[3])) {
+            dev->active_addr = dev->paddr;
+            image_view_on(bus, dev->laddr, 0x00);
+            active_source(bus, dev->laddr, dev->paddr);
             menu_state = true;
-            menu_status(laddr, 0x00, menu_state);
+            menu_status(bus, dev->laddr, 0x00, menu_state);
             no_active = 0;
             blink_set_blink(BLINK_STATE_GREEN_2HZ);
           }
@@ -292,17 +483,17 @@ void cec_task(void *param) {
         case CEC_ID_DEVICE_VENDOR_ID:
           // On broadcast receive, do the same
           if ((initiator == 0x00) && (destination == 0x0f)) {
-            device_vendor_id(laddr, 0x0f, 0x0010FA);
+            device_vendor_id(bus, dev->laddr, 0x0f, 0x0010FA);
           }
           break;
         case CEC_ID_GIVE_DEVICE_VENDOR_ID:
-          if (destination == laddr)
-            device_vendor_id(laddr, 0x0f, 0x0010FA);
+          if (claimed(dev, destination))
+            device_vendor_id(bus, destination, 0x0f, 0x0010FA);
           break;
         case CEC_ID_MENU_STATUS:
           break;
         case CEC_ID_MENU_REQUEST:
-          if (destination == laddr) {
+          if (claimed(dev, destination)) {
             cec_menu_t request = (uint8_t)pld[2];
             switch (request) {
               case CEC_MENU_ACTIVATE:
@@ -314,16 +505,16 @@ void cec_task(void *param) {
               case CEC_MENU_QUERY:
                 break;
             }
-            menu_status(laddr, initiator, menu_state);
+            menu_status(bus, destination, initiator, menu_state);
           }
           break;
         case CEC_ID_GIVE_DEVICE_POWER_STATUS:
-          if (destination == laddr)
-            report_power_status(laddr, initiator, active_addr != paddr);
+          if (claimed(dev, destination))
+            report_power_status(bus, destination, initiator, dev->active_addr != dev->paddr);
 #if 0
           /* Hack for Google Chromecast to force it sending V+/V- if no CEC TV is present */
           if (destination == 0)
-            report_power_status(0, initiator, 0x00);
+            report_power_status(bus, 0, initiator, 0x00);
 #endif
           break;
         case CEC_ID_REPORT_POWER_STATUS:
@@ -335,39 +526,40 @@ void cec_task(void *param) {
         case CEC_ID_CEC_VERSION:
           break;
         case CEC_ID_GET_CEC_VERSION:
-          if (destination == laddr) {
-            report_cec_version(laddr, initiator);
+          if (claimed(dev, destination)) {
+            report_cec_version(bus, destination, initiator);
           }
           break;
         case CEC_ID_GIVE_OSD_NAME:
-          if (destination == laddr)
-            set_osd_name(laddr, initiator);
+          if (claimed(dev, destination))
+            set_osd_name(bus, destination, initiator);
           break;
         case CEC_ID_SET_OSD_NAME:
           break;
         case CEC_ID_GIVE_PHYSICAL_ADDRESS:
-          if (destination == laddr && paddr != 0x0000)
-            report_physical_address(laddr, 0x0f, paddr, config.device_type);
+          if (claimed(dev, destination) && dev->paddr != 0x0000)
+            report_physical_address(bus, destination, 0x0f, dev->paddr,
+                                    device_type(dev, destination));
           break;
         case CEC_ID_USER_CONTROL_PRESSED:
-          if (destination == laddr) {
+          // keys to any of our addresses, eg. volume keys to the audio system
+          if (claimed(dev, destination)) {
             blink_set(BLINK_STATE_GREEN_ON);
-            command_t command = config.keymap[pld[2]];
-            if (command.name != NULL) {
-              xQueueSend(*q, &command.key, pdMS_TO_TICKS(10));
+            uint8_t key = dev->config.keymap[pld[2]];
+            if (key != 0x00) {
+              usb_hid_send_key(key);
             }
           }
           break;
         case CEC_ID_USER_CONTROL_RELEASED:
-          if (destination == laddr) {
+          if (claimed(dev, destination)) {
             blink_set(BLINK_STATE_OFF);
-            key = HID_KEY_NONE;
-            xQueueSend(*q, &key, pdMS_TO_TICKS(10));
+            usb_hid_send_key(HID_KEY_NONE);
           }
           break;
         case CEC_ID_ABORT:
-          if (destination == laddr) {
-            cec_feature_abort(laddr, initiator, pld[1], CEC_ABORT_REFUSED);
+          if (claimed(dev, destination)) {
+            cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_REFUSED);
           }
           break;
         case CEC_ID_FEATURE_ABORT:
@@ -375,8 +567,8 @@ void cec_task(void *param) {
         case CEC_ID_VENDOR_COMMAND_WITH_ID:
           break;
         default:
-          if (destination == laddr) {
-            cec_feature_abort(laddr, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+          if (claimed(dev, destination)) {
+            cec_feature_abort(bus, destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
           }
           break;
       }
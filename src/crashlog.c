@@ -0,0 +1,174 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "pico/stdlib.h"
+
+#include "crc/crc32.h"
+
+#include "pico-cec/util.h"
+
+#include "crashlog.h"
+#include "ws2812.h"
+
+#define CRASHLOG_MAGIC (0x43524153)  // "CRAS"
+
+/** Time to show the crash colour before the watchdog reboots us. */
+#define CRASHLOG_REBOOT_DELAY_MS (1000)
+
+/**
+ * Retained crash log.
+ *
+ * Lives in RAM which is not cleared by the runtime, so it survives a
+ * watchdog or RUN pin reset (but not a power cycle). Events are copied in
+ * with interrupts briefly disabled and no checksum, the CRC over the whole
+ * log is only computed when a crash seals it. A hang has no chance to seal
+ * the log, after a watchdog timeout it is kept on the magic alone.
+ */
+typedef struct {
+  uint32_t magic;
+  crashlog_t log;
+  uint32_t crc;
+} crashlog_ram_t;
+
+static crashlog_ram_t __uninitialized_ram(crashlog_ram);
+
+/** Copy of the previous boot's log, if valid. */
+static crashlog_t previous;
+static bool previous_valid = false;
+
+static const char *reason_names[] = {
+    [CRASHLOG_REASON_RESET] = "reset",
+    [CRASHLOG_REASON_HARDFAULT] = "hard fault",
+    [CRASHLOG_REASON_STACK_OVERFLOW] = "stack overflow",
+    [CRASHLOG_REASON_WATCHDOG] = "watchdog",
+};
+
+static uint32_t checksum(void) {
+  return crc32((unsigned char *)&crashlog_ram.log, sizeof(crashlog_ram.log));
+}
+
+static void set_task(const char *name) {
+  memset(crashlog_ram.log.task, 0, sizeof(crashlog_ram.log.task));
+  if (name != NULL) {
+    strncpy(crashlog_ram.log.task, name, sizeof(crashlog_ram.log.task) - 1);
+  }
+}
+
+/**
+ * Record the cause of a fatal error then reboot via the watchdog.
+ */
+static void __attribute__((noreturn)) fatal(uint32_t reason, const char *task) {
+  crashlog_ram.log.reason = reason;
+  crashlog_ram.log.uptime_ms = util_uptime_ms();
+  set_task(task);
+  crashlog_ram.crc = checksum();
+
+  // solid red on RGB to indicate crash
+  ws2812_put_rgb(0x78, 0, 0);
+
+  watchdog_reboot(0, 0, CRASHLOG_REBOOT_DELAY_MS);
+  while (true) {
+    tight_loop_contents();
+  }
+}
+
+/**
+ * Check the previous boot's log is worth keeping, a crash or a hang.
+ */
+static bool retain(void) {
+  if (crashlog_ram.magic != CRASHLOG_MAGIC) {
+    return false;
+  }
+
+  if (crashlog_ram.log.reason != CRASHLOG_REASON_RESET) {
+    return (crashlog_ram.crc == checksum());
+  }
+
+  if (watchdog_enable_caused_reboot()) {
+    crashlog_ram.log.reason = CRASHLOG_REASON_WATCHDOG;
+    memset(&crashlog_ram.log.regs, 0, sizeof(crashlog_ram.log.regs));
+    set_task(NULL);
+    return true;
+  }
+
+  return false;
+}
+
+void crashlog_init(void) {
+  if (retain()) {
+    previous = crashlog_ram.log;
+    previous_valid = true;
+  }
+
+  memset(&crashlog_ram, 0, sizeof(crashlog_ram));
+  crashlog_ram.magic = CRASHLOG_MAGIC;
+  crashlog_ram.log.reason = CRASHLOG_REASON_RESET;
+}
+
+const crashlog_t *crashlog_get(void) {
+  return previous_valid ? &previous : NULL;
+}
+
+const char *crashlog_reason_name(uint32_t reason) {
+  if (reason < (sizeof(reason_names) / sizeof(reason_names[0]))) {
+    return reason_names[reason];
+  }
+
+  return "unknown";
+}
+
+void crashlog_event(uint8_t flags, const uint8_t *data, uint8_t len) {
+  uint32_t timestamp_ms = util_uptime_ms();
+  uint32_t irqs = save_and_disable_interrupts();
+
+  crashlog_event_t *event = &crashlog_ram.log.events[crashlog_ram.log.head % CRASHLOG_EVENT_COUNT];
+  // flagged until complete, in case of a fault part way through
+  event->flags = CRASHLOG_EVENT_INVALID;
+  event->timestamp_ms = timestamp_ms;
+  event->len = len;
+  event->data[0] = len > 0 ? data[0] : 0x00;
+  event->data[1] = len > 1 ? data[1] : 0x00;
+  event->flags = flags;
+  crashlog_ram.log.head++;
+  crashlog_ram.log.uptime_ms = timestamp_ms;
+
+  restore_interrupts(irqs);
+}
+
+void crashlog_stack_overflow(const char *task) {
+  fatal(CRASHLOG_REASON_STACK_OVERFLOW, task);
+}
+
+/**
+ * C half of the hard fault handler, frame is the stacked exception frame.
+ */
+void __attribute__((used, noreturn)) crashlog_hardfault(const uint32_t *frame) {
+  memcpy(&crashlog_ram.log.regs, frame, sizeof(crashlog_ram.log.regs));
+
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  fatal(CRASHLOG_REASON_HARDFAULT, task != NULL ? pcTaskGetName(task) : NULL);
+}
+
+/**
+ * Hard fault handler, overrides the SDK default breakpoint.
+ *
+ * Selects the stack the exception frame was pushed to (bit 2 of EXC_RETURN)
+ * and hands it to crashlog_hardfault(). Thumb-1 only, for Cortex-M0+ too.
+ */
+void __attribute__((naked)) isr_hardfault(void) {
+  __asm volatile(
+      "movs r0, #4\n"
+      "mov r1, lr\n"
+      "tst r0, r1\n"
+      "beq 1f\n"
+      "mrs r0, psp\n"
+      "bl crashlog_hardfault\n"
+      "1:\n"
+      "mrs r0, msp\n"
+      "bl crashlog_hardfault\n");
+}
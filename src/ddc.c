@@ -1,169 +1,682 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "task.h"
+
+#include "hardware/dma.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
 #include "pico/stdlib.h"
 
+#include "crc/crc32.h"
+
+#include "pico-cec/config.h"
+
+#include "cec-frame.h"
 #include "cec-log.h"
 #include "ddc.h"
+#include "edid.h"
+#include "nvs.h"
 
-#define EDID_BLOCK_SIZE (128)
 #define EDID_I2C_TIMEOUT_US (100 * 1000)
 #define EDID_I2C_ADDR (0x50)
-#define EDID_I2C_READ_SIZE (EDID_BLOCK_SIZE * 2)
-#define EDID_CTA_DTD_START (0x02)
-#define EDID_CTA_DBC_OFFSET (0x04)
+#define EDID_SEGMENT_ADDR (0x30)
+
+/** Bus speeds, indexed by ddc_speed_t. */
+#define I2C_STANDARD_FREQUENCY (100 * 1000)
+#define I2C_FAST_FREQUENCY (400 * 1000)
+
+/** Timeout for a block transfer, 128 bytes take about 12 ms at 100 kHz. */
+#define DDC_BLOCK_TIMEOUT_MS (100)
+
+/** Task notification bits. */
+#define DDC_NOTIFY_REFRESH (1 << 0)
+#define DDC_NOTIFY_CANCEL (1 << 1)
+#define DDC_NOTIFY_DONE (1 << 2)
+#define DDC_NOTIFY_ERROR (1 << 3)
+#define DDC_NOTIFY_HPD (1 << 4)
+#define DDC_NOTIFY_CONFIRM (1 << 5)
+
+/** Read completion event bits, for ddc_refresh_wait(). */
+#define DDC_EVENT_OK (1 << 0)
+#define DDC_EVENT_FAILED (1 << 1)
+
+/** Hot plug detect must be stable this long, shorter pulses are not a replug. */
+#define HPD_DEBOUNCE_MS (100)
+
+/**
+ * Half an I2C clock period, for the bit-banged segment pointer write.
+ *
+ * Always standard mode, it is only two bytes.
+ */
+#define I2C_HALF_PERIOD_US (500 * 1000 / I2C_STANDARD_FREQUENCY)
+
+static const uint32_t frequencies[DDC_SPEED_COUNT] = {
+    [DDC_SPEED_STANDARD] = I2C_STANDARD_FREQUENCY,
+    [DDC_SPEED_FAST] = I2C_FAST_FREQUENCY,
+};
+
+static StaticTask_t ddc_task_static;
+static StackType_t ddc_stack[DDC_STACK_SIZE];
+static TaskHandle_t xDDCTask;
+
+/** DMA channels, commands are fed to the I2C block and data read back. */
+static int dma_tx;
+static int dma_rx;
+static dma_channel_config dma_tx_config;
+static dma_channel_config dma_rx_config;
+
+/** I2C command stream for a block read, the offset write then 128 reads. */
+static uint32_t commands[1 + EDID_BLOCK_SIZE];
+
+/** Result of the last successful read. */
+static volatile uint16_t physical_address = 0x0000;
+
+/** Outcome of the last completed read, set once it is cached. */
+static EventGroupHandle_t read_events;
+static StaticEventGroup_t read_events_static;
+
+/** Delay before the next requested read, for the EDID to settle. */
+static volatile TickType_t refresh_delay = 0;
+
+/** Fingerprint of the last sink, persisted so it survives a reboot. */
+static nvs_edid_t fingerprint;
+static bool fingerprinted = false;
 
-#define I2C_MASTER_FREQUENCY (100 * 1000)
+/** Raw EDID of the last sink, for show edid, never logged. */
+static uint8_t raw[DDC_EDID_KEPT_BLOCKS * EDID_BLOCK_SIZE];
+static size_t raw_len = 0;
 
-const uint8_t header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
-const uint8_t ctahdr[2] = {0x02, 0x03};
-const uint8_t vsbhdr[3] = {0x03, 0x0c, 0x00};
+/** Capabilities decoded from the last sink's EDID. */
+static edid_info_t decoded;
+static bool decoded_valid = false;
 
-static void ddc_init() {
-  i2c_init(i2c_default, I2C_MASTER_FREQUENCY);
+/**
+ * Outcome of an EDID read.
+ */
+typedef struct {
+  /** Decoded capabilities, including the physical address. */
+  edid_info_t info;
+  /** CRC32 of block 0. */
+  uint32_t block_crc;
+  /** Blocks read. */
+  unsigned int blocks;
+  /** Block 0 matched the fingerprint on a confirming read, the rest were not read. */
+  bool unchanged;
+} ddc_read_t;
+
+/** Set when the read in progress was cancelled rather than failed. */
+static bool cancelled = false;
+
+/** Bus speed of the next read, the last that worked for the sink. */
+static ddc_stats_t stats = {.current = DDC_SPEED_FAST};
+
+#ifdef CEC_HPD_PIN
+/** Debounced hot plug detect level. */
+static bool hpd_level = false;
+#endif
+
+static void bus_init(ddc_speed_t speed) {
+  i2c_init(i2c_default, frequencies[speed]);
   gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
   gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
   gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
   gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
 }
 
-static void ddc_exit() {
+static void bus_exit(void) {
   i2c_deinit(i2c_default);
 }
 
 /**
- * Calculate and verify EDID checksum.
+ * Release (high) or drive low an open drain line.
+ */
+static void line_set(uint pin, bool high) {
+  gpio_set_dir(pin, high ? GPIO_IN : GPIO_OUT);
+  busy_wait_us_32(I2C_HALF_PERIOD_US);
+}
+
+/**
+ * Release SCL, waiting out any clock stretching by the sink.
  */
-static int verify(uint8_t *edid, size_t len) {
-  uint16_t cksum = 0x0000;
+static bool scl_release(void) {
+  gpio_set_dir(PICO_DEFAULT_I2C_SCL_PIN, GPIO_IN);
 
-  // log the data
-  if ((len % 8) == 0) {
-    for (size_t i = 0; i < len; i += 8) {
-      cec_log_submitf("[%d] %02x %02x %02x %02x %02x %02x %02x %02x"_LOG_BR, i, edid[i],
-                      edid[i + 1], edid[i + 2], edid[i + 3], edid[i + 4], edid[i + 5], edid[i + 6],
-                      edid[i + 7]);
+  uint32_t start = time_us_32();
+  while (!gpio_get(PICO_DEFAULT_I2C_SCL_PIN)) {
+    if ((time_us_32() - start) > EDID_I2C_TIMEOUT_US) {
+      return false;
     }
-  } else {
-    for (size_t i = 0; i < len; i++) {
-      cec_log_submitf("[%d] %02x"_LOG_BR, i, edid[i]);
+  }
+  busy_wait_us_32(I2C_HALF_PERIOD_US);
+
+  return true;
+}
+
+/**
+ * Clock out a byte, SCL low on entry and exit, returns true if acknowledged.
+ */
+static bool write_byte(uint8_t byte) {
+  for (int bit = 7; bit >= 0; bit--) {
+    line_set(PICO_DEFAULT_I2C_SDA_PIN, byte & (1 << bit));
+    if (!scl_release()) {
+      return false;
     }
+    line_set(PICO_DEFAULT_I2C_SCL_PIN, false);
   }
 
-  // calculate the checksum
-  for (size_t i = 0; i < len; i++) {
-    cksum += edid[i];
+  // ack clock
+  line_set(PICO_DEFAULT_I2C_SDA_PIN, true);
+  if (!scl_release()) {
+    return false;
   }
+  bool ack = !gpio_get(PICO_DEFAULT_I2C_SDA_PIN);
+  line_set(PICO_DEFAULT_I2C_SCL_PIN, false);
 
-  return ((cksum & 0x00ff) == 0x00 ? PICO_ERROR_NONE : PICO_ERROR_GENERIC);
+  return ack;
 }
 
 /**
- * Read a 256 byte block and verify the EDID block checksums.
+ * Write the E-DDC segment pointer.
+ *
+ * The segment pointer is reset by a STOP, so it must be followed by a repeated
+ * start to the EDID address. The I2C block always issues a STOP when its
+ * target address changes, so the write is bit-banged and the bus released
+ * without a STOP, the I2C block's following START is then a repeated start as
+ * far as the sink is concerned.
  */
-static int read_edid_block(uint8_t *edid, size_t len) {
-  int ret = i2c_read_timeout_us(i2c_default, EDID_I2C_ADDR, edid, len, false, EDID_I2C_TIMEOUT_US);
-  if (ret != len) {
-    cec_log_submitf("Failed to read %d bytes from 0x%02x"_LOG_BR, len, EDID_I2C_ADDR);
-    return PICO_ERROR_GENERIC;
+static bool write_segment(uint8_t segment) {
+  uint pins[] = {PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN};
+
+  for (unsigned int i = 0; i < 2; i++) {
+    gpio_put(pins[i], false);
+    gpio_set_dir(pins[i], GPIO_IN);
+    gpio_set_function(pins[i], GPIO_FUNC_SIO);
   }
 
-  if (verify(edid, len)) {
-    cec_log_submitf("Failed to verify EDID block checksum"_LOG_BR);
-    return PICO_ERROR_GENERIC;
+  // start, then address and segment
+  line_set(PICO_DEFAULT_I2C_SDA_PIN, false);
+  line_set(PICO_DEFAULT_I2C_SCL_PIN, false);
+  bool ack = write_byte(EDID_SEGMENT_ADDR << 1) && write_byte(segment);
+
+  // release SDA then SCL, no STOP
+  line_set(PICO_DEFAULT_I2C_SDA_PIN, true);
+  scl_release();
+
+  for (unsigned int i = 0; i < 2; i++) {
+    gpio_set_function(pins[i], GPIO_FUNC_I2C);
   }
 
-  cec_log_submitf("Read %d bytes from 0x%02x"_LOG_BR, ret, EDID_I2C_ADDR);
+  return ack;
+}
 
-  return PICO_ERROR_NONE;
+/**
+ * DMA completion, the last byte of the block has been read.
+ */
+static void dma_isr(void) {
+  if (dma_channel_get_irq1_status(dma_rx)) {
+    dma_channel_acknowledge_irq1(dma_rx);
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(xDDCTask, DDC_NOTIFY_DONE, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
 }
 
 /**
- * Parse a data block and return the physical address if found.
- *
- * Returns 0x0000 if the block is not a vendor specific data block or the
- * physical address is not found.
+ * I2C transfer aborted, eg. not acknowledged.
  */
-static uint16_t find_physical_address(uint8_t *block, size_t len) {
-  if (len < 4) {
-    // Too short for Vendor Specific Data Block
-    return 0x0000;
+static void i2c_isr(void) {
+  i2c_hw_t *hw = i2c_get_hw(i2c_default);
+
+  if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+    (void)hw->clr_tx_abrt;
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(xDDCTask, DDC_NOTIFY_ERROR, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
   }
+}
 
-  if (memcmp(&block[1], vsbhdr, 3) == 0) {
-    // HDMI Licensing, LLC block
-    uint16_t addr = (block[4] << 8) | block[3];
-    cec_log_submitf("  physical address = %04x"_LOG_BR, addr);
-    return addr;
+#ifdef CEC_HPD_PIN
+/**
+ * Hot plug detect edge, debounced by the ddc task.
+ */
+static void hpd_isr(void) {
+  uint32_t events = gpio_get_irq_event_mask(CEC_HPD_PIN);
+
+  if (events & (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)) {
+    gpio_acknowledge_irq(CEC_HPD_PIN, events);
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(xDDCTask, DDC_NOTIFY_HPD, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+/**
+ * Wait for hot plug detect to settle, returns the notification bits which
+ * arrived meanwhile, plus a refresh if the sink was plugged in. The physical
+ * address is cleared as soon as the sink is unplugged.
+ */
+static uint32_t hpd_debounce(void) {
+  uint32_t pending = 0;
+  uint32_t bits;
+
+  do {
+    vTaskDelay(pdMS_TO_TICKS(HPD_DEBOUNCE_MS));
+    bits = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &bits, 0);
+    pending |= bits & ~DDC_NOTIFY_HPD;
+  } while (bits & DDC_NOTIFY_HPD);
+
+  bool level = gpio_get(CEC_HPD_PIN);
+  if (level != hpd_level) {
+    hpd_level = level;
+    stats.hpd_events++;
+    CEC_LOG_INFO(CEC_LOG_DDC, "Hot plug %s", level ? "asserted" : "deasserted");
+
+    if (level) {
+      pending |= DDC_NOTIFY_REFRESH;
+    } else if (physical_address != 0x0000) {
+      // unplugged, the address is stale until the EDID of whatever is plugged
+      // in next is read, which then announces it as a change
+      vTaskSuspendAll();
+      decoded_valid = false;
+      xTaskResumeAll();
+      physical_address = 0x0000;
+      cec_frame_wake();
+    }
   }
 
-  return 0x0000;
+  return pending;
 }
+#endif
 
-static uint16_t get_physical_address(void) {
-  uint8_t edid[EDID_I2C_READ_SIZE] = {0};
+/**
+ * Stop the DMA channels, the I2C block is reset by bus_exit().
+ */
+static void abort_dma(void) {
+  // the abort may raise a spurious completion interrupt (RP2040-E13)
+  dma_channel_set_irq1_enabled(dma_rx, false);
+  dma_channel_abort(dma_tx);
+  dma_channel_abort(dma_rx);
+  dma_channel_acknowledge_irq1(dma_rx);
+  dma_channel_set_irq1_enabled(dma_rx, true);
+}
+
+/**
+ * Read a block with DMA, blocking this task until done, failed, timed out or
+ * cancelled.
+ */
+static int read_dma(uint8_t offset, uint8_t *edid) {
+  i2c_hw_t *hw = i2c_get_hw(i2c_default);
+
+  // a cancel requested before the transfer started is kept
+  ulTaskNotifyValueClear(NULL, DDC_NOTIFY_DONE | DDC_NOTIFY_ERROR);
+
+  hw->enable = 0;
+  hw->tar = EDID_I2C_ADDR;
+  hw->enable = 1;
+  hw->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  hw->dma_cr = I2C_IC_DMA_CR_RDMAE_BITS | I2C_IC_DMA_CR_TDMAE_BITS;
 
-  if (read_edid_block(edid, EDID_I2C_READ_SIZE)) {
-    return 0x0000;
+  commands[0] = offset;
+  for (unsigned int i = 1; i <= EDID_BLOCK_SIZE; i++) {
+    commands[i] = I2C_IC_DATA_CMD_CMD_BITS;
+  }
+  commands[1] |= I2C_IC_DATA_CMD_RESTART_BITS;
+  commands[EDID_BLOCK_SIZE] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+  dma_channel_configure(dma_rx, &dma_rx_config, edid, &hw->data_cmd, EDID_BLOCK_SIZE, true);
+  dma_channel_configure(dma_tx, &dma_tx_config, &hw->data_cmd, commands, 1 + EDID_BLOCK_SIZE,
+                        true);
+
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(DDC_BLOCK_TIMEOUT_MS);
+  uint32_t bits = 0;
+
+  // refresh requests may wake us early, they are left pending
+  while (!(bits & (DDC_NOTIFY_DONE | DDC_NOTIFY_ERROR | DDC_NOTIFY_CANCEL))) {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout ||
+        xTaskNotifyWait(0, DDC_NOTIFY_DONE | DDC_NOTIFY_ERROR | DDC_NOTIFY_CANCEL, &bits,
+                        timeout - elapsed) != pdTRUE) {
+      abort_dma();
+      return PICO_ERROR_TIMEOUT;
+    }
   }
 
-  if (memcmp(edid, header, 8)) {
-    // not an EDID block
-    return 0x0000;
+  if (bits & DDC_NOTIFY_DONE) {
+    return PICO_ERROR_NONE;
   }
 
-  cec_log_submitf(" EDID header"_LOG_BR);
-  if (edid[126] == 0x00) {
-    cec_log_submitf("Missing CTA extensions"_LOG_BR);
-    return 0x0000;
+  abort_dma();
+  if (bits & DDC_NOTIFY_CANCEL) {
+    CEC_LOG_INFO(CEC_LOG_DDC, "Read cancelled");
+    cancelled = true;
   }
 
-  uint8_t *cta = &edid[EDID_BLOCK_SIZE];
-  if (memcmp(cta, ctahdr, 2) == 0) {
-    // Valid CTA extension block
-    cec_log_submitf(" CTA Extension"_LOG_BR);
-    cec_log_submitf("    DTD start: 0x%02x"_LOG_BR, cta[EDID_CTA_DTD_START]);
+  return PICO_ERROR_GENERIC;
+}
+
+/**
+ * Read and verify the checksum of an EDID block.
+ *
+ * Blocks are addressed as 256 byte segments of two blocks each, segment 0
+ * needs no segment pointer.
+ */
+static int read_edid_block(unsigned int index, uint8_t *edid) {
+  uint8_t segment = index / 2;
+  uint8_t offset = (index % 2) * EDID_BLOCK_SIZE;
 
-    uint8_t offset = EDID_CTA_DBC_OFFSET;
-    for (uint8_t i = offset; i < cta[EDID_CTA_DTD_START];) {
-      uint8_t *db = &cta[i];
-      uint8_t len = (db[0] & 0x1f);
-      cec_log_submitf("  [%u](%u) data block: %02x"_LOG_BR, i, len, db[0]);
-      if (len == 0x00) {
-        i++;
-        continue;
+  if (segment > 0 && !write_segment(segment)) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to write segment %u to 0x%02x", segment,
+                  EDID_SEGMENT_ADDR);
+    return PICO_ERROR_GENERIC;
+  }
+
+  int ret = read_dma(offset, edid);
+  if (ret != PICO_ERROR_NONE) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to read block %u from 0x%02x: %s", index, EDID_I2C_ADDR,
+                  ret == PICO_ERROR_TIMEOUT ? "timeout" : "generic");
+    return ret;
+  }
+
+  if (!edid_checksum_ok(edid)) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to verify EDID block %u checksum", index);
+    return PICO_ERROR_GENERIC;
+  }
+
+  return PICO_ERROR_NONE;
+}
+
+/**
+ * Keep a copy of a block for show edid, a new sink discards the old blocks.
+ */
+static void keep_block(unsigned int index, const uint8_t *block) {
+  if (index >= DDC_EDID_KEPT_BLOCKS) {
+    return;
+  }
+
+  vTaskSuspendAll();
+  if (index == 0 && memcmp(raw, block, EDID_BLOCK_SIZE) != 0) {
+    raw_len = 0;
+  }
+  memcpy(&raw[index * EDID_BLOCK_SIZE], block, EDID_BLOCK_SIZE);
+  if (raw_len < (index + 1) * EDID_BLOCK_SIZE) {
+    raw_len = (index + 1) * EDID_BLOCK_SIZE;
+  }
+  xTaskResumeAll();
+}
+
+/**
+ * Stream EDID blocks through the parser until the physical address is found
+ * or the extensions run out.
+ *
+ * A confirming read stops after block 0 if it matches the fingerprint. This
+ * is only good enough straight after boot, the physical address is in a CTA
+ * extension and changes without block 0 changing when we are moved to another
+ * of its inputs.
+ *
+ * Returns false if the EDID could not be read.
+ */
+static bool read_physical_address(ddc_speed_t speed, bool confirm, ddc_read_t *result) {
+  uint8_t block[EDID_BLOCK_SIZE];
+  edid_parser_t parser;
+  edid_parse_t state = EDID_PARSE_MORE;
+
+  edid_parser_init(&parser);
+
+  bus_init(speed);
+
+  for (unsigned int i = 0; state == EDID_PARSE_MORE; i++) {
+    if (read_edid_block(i, block)) {
+      state = EDID_PARSE_ERROR;
+      break;
+    }
+
+    result->blocks = i + 1;
+    keep_block(i, block);
+
+    if (i == 0) {
+      // block 0 carries the vendor, product and serial, so a matching
+      // checksum is the same sink and the rest need not be read
+      result->block_crc = crc32(block, sizeof(block));
+      if (confirm && fingerprinted && result->block_crc == fingerprint.block_crc) {
+        result->unchanged = true;
+        parser.info = fingerprint.info;
+        state = EDID_PARSE_DONE;
+        break;
       }
+    }
+
+    state = edid_parse_block(&parser, i, block);
+  }
+
+  bus_exit();
+
+  if (state == EDID_PARSE_DONE && parser.blocks == 1) {
+    CEC_LOG_WARN(CEC_LOG_DDC, "Missing CTA extensions");
+  }
+
+  result->info = parser.info;
+
+  return state == EDID_PARSE_DONE;
+}
+
+/**
+ * Read the physical address at a bus speed, accounting the time taken.
+ *
+ * Logs a single line per successful read.
+ */
+static bool timed_read(ddc_speed_t speed, bool confirm, ddc_read_t *result) {
+  uint32_t start = time_us_32();
+
+  *result = (ddc_read_t){0x0};
+  bool ok = read_physical_address(speed, confirm, result);
+
+  uint32_t elapsed = time_us_32() - start;
+  if (ok) {
+    CEC_LOG_INFO(CEC_LOG_DDC, "EDID %s: %u block(s), physical address %04x, %lu kHz, %lu us",
+                 result->unchanged ? "unchanged" : "read", result->blocks,
+                 result->info.physical_address, (unsigned long)(frequencies[speed] / 1000),
+                 (unsigned long)elapsed);
+    stats.speed[speed].reads++;
+    stats.speed[speed].last_us = elapsed;
+    if (elapsed > stats.speed[speed].max_us) {
+      stats.speed[speed].max_us = elapsed;
+    }
+  } else if (!cancelled) {
+    stats.speed[speed].errors++;
+  }
+
+  return ok;
+}
+
+static void ddc_task(void *param) {
+  while (true) {
+    uint32_t bits = 0;
+
+    // anything but a refresh request is stale by now
+    xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+#ifdef CEC_HPD_PIN
+    if (bits & DDC_NOTIFY_HPD) {
+      bits |= hpd_debounce();
+    }
+#endif
+    if (!(bits & (DDC_NOTIFY_REFRESH | DDC_NOTIFY_CONFIRM))) {
+      continue;
+    }
+
+    // any other request may be for a sink on a new input, read it all
+    bool confirm = !(bits & DDC_NOTIFY_REFRESH);
+
+    if (refresh_delay > 0) {
+      TickType_t delay = refresh_delay;
+      refresh_delay = 0;
+      vTaskDelay(delay);
+    }
 
-      uint16_t addr = find_physical_address(db, len);
-      if (addr != 0x0000) {
-        return addr;
+    ddc_read_t result;
+    ddc_speed_t speed = stats.current;
+    bool fallback = false;
+
+    cancelled = false;
+    bool ok = timed_read(speed, confirm, &result);
+    if (!ok && !cancelled && speed == DDC_SPEED_FAST) {
+      // bus errors and bad checksums alike, the sink may not cope with fast mode
+      CEC_LOG_WARN(CEC_LOG_DDC, "Falling back to %lu kHz",
+                   (unsigned long)(frequencies[DDC_SPEED_STANDARD] / 1000));
+      speed = DDC_SPEED_STANDARD;
+      fallback = true;
+      ok = timed_read(speed, confirm, &result);
+    }
+
+    if (ok) {
+      uint16_t address = result.info.physical_address;
+      uint32_t block_crc = result.block_crc;
+
+      vTaskSuspendAll();
+      decoded = result.info;
+      decoded_valid = true;
+      xTaskResumeAll();
+
+      if (address != physical_address) {
+        physical_address = address;
+        // let the CEC task announce it now rather than after the next frame
+        cec_frame_wake();
       }
 
-      i += len + 1;  // payload + header
+      // a sink is only read in standard mode once it has failed in fast mode,
+      // a new one gets its own chance
+      bool same = fingerprinted && block_crc == fingerprint.block_crc;
+      ddc_speed_t sink_speed =
+          fallback ? DDC_SPEED_STANDARD : (same ? fingerprint.speed : DDC_SPEED_FAST);
+      stats.current = sink_speed;
+
+      if (!same || sink_speed != fingerprint.speed ||
+          memcmp(&result.info, &fingerprint.info, sizeof(result.info)) != 0) {
+        nvs_edid_t edid = {.block_crc = block_crc, .speed = sink_speed, .info = result.info};
+        if (nvs_save_edid(&edid)) {
+          fingerprint = edid;
+          fingerprinted = true;
+        }
+      }
     }
+    xEventGroupSetBits(read_events, ok ? DDC_EVENT_OK : DDC_EVENT_FAILED);
   }
+}
+
+void ddc_init(void) {
+  dma_tx = dma_claim_unused_channel(true);
+  dma_tx_config = dma_channel_get_default_config(dma_tx);
+  channel_config_set_transfer_data_size(&dma_tx_config, DMA_SIZE_32);
+  channel_config_set_read_increment(&dma_tx_config, true);
+  channel_config_set_write_increment(&dma_tx_config, false);
+  channel_config_set_dreq(&dma_tx_config, i2c_get_dreq(i2c_default, true));
+
+  dma_rx = dma_claim_unused_channel(true);
+  dma_rx_config = dma_channel_get_default_config(dma_rx);
+  channel_config_set_transfer_data_size(&dma_rx_config, DMA_SIZE_8);
+  channel_config_set_read_increment(&dma_rx_config, false);
+  channel_config_set_write_increment(&dma_rx_config, true);
+  channel_config_set_dreq(&dma_rx_config, i2c_get_dreq(i2c_default, false));
+
+  dma_channel_set_irq1_enabled(dma_rx, true);
+  irq_add_shared_handler(DMA_IRQ_1, dma_isr, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_1, true);
+
+  irq_set_exclusive_handler(I2C0_IRQ + i2c_hw_index(i2c_default), i2c_isr);
+  irq_set_enabled(I2C0_IRQ + i2c_hw_index(i2c_default), true);
+
+  // the last sink's address is usable straight away, confirmed by a read
+  fingerprinted = nvs_read_edid(&fingerprint) && fingerprint.speed < DDC_SPEED_COUNT;
+  if (fingerprinted) {
+    physical_address = fingerprint.info.physical_address;
+    stats.current = fingerprint.speed;
+    decoded = fingerprint.info;
+    decoded_valid = true;
+  }
+
+#ifdef CEC_HPD_PIN
+  gpio_init(CEC_HPD_PIN);
+  gpio_disable_pulls(CEC_HPD_PIN);
+  hpd_level = gpio_get(CEC_HPD_PIN);
+  gpio_add_raw_irq_handler(CEC_HPD_PIN, hpd_isr);
+  gpio_set_irq_enabled(CEC_HPD_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+#endif
 
-  return 0x0000;
+  read_events = xEventGroupCreateStatic(&read_events_static);
+
+  xDDCTask = xTaskCreateStatic(ddc_task, DDC_TASK_NAME, DDC_STACK_SIZE, NULL, DDC_PRIORITY,
+                               &ddc_stack[0], &ddc_task_static);
 }
 
 uint16_t ddc_get_physical_address(void) {
-  uint8_t zero = 0x00;
-  uint16_t address = 0x0000;
+  return physical_address;
+}
+
+void ddc_refresh(void) {
+  xTaskNotify(xDDCTask, DDC_NOTIFY_REFRESH, eSetBits);
+}
+
+void ddc_get_stats(ddc_stats_t *out) {
+  *out = stats;
+}
 
-  ddc_init();
+uint32_t ddc_get_frequency(ddc_speed_t speed) {
+  return frequencies[speed];
+}
 
-  cec_log_submitf("%s"_LOG_BR, "Issuing DDC reset");
-  // issue a DDC reset
-  int ret = i2c_write_timeout_us(i2c_default, EDID_I2C_ADDR, &zero, 1, true, EDID_I2C_TIMEOUT_US);
-  if (ret != 1) {
-    cec_log_submitf("Failed to write DDC reset: %s"_LOG_BR,
-                    ret == PICO_ERROR_TIMEOUT ? "timeout" : "generic");
-    return 0x0000;
+size_t ddc_get_edid(uint8_t *edid, size_t len) {
+  vTaskSuspendAll();
+  if (len > raw_len) {
+    len = raw_len;
   }
+  memcpy(edid, raw, len);
+  xTaskResumeAll();
+
+  return len;
+}
+
+bool ddc_get_info(edid_info_t *info) {
+  vTaskSuspendAll();
+  bool valid = decoded_valid;
+  *info = decoded;
+  xTaskResumeAll();
 
-  address = get_physical_address();
-  ddc_exit();
+  return valid;
+}
+
+bool ddc_has_cached_address(void) {
+  return fingerprinted && fingerprint.info.physical_address != 0x0000;
+}
+
+void ddc_confirm_delayed(TickType_t delay) {
+  refresh_delay = delay;
+  xTaskNotify(xDDCTask, DDC_NOTIFY_CONFIRM, eSetBits);
+}
+
+void ddc_cancel(void) {
+  xTaskNotify(xDDCTask, DDC_NOTIFY_CANCEL, eSetBits);
+}
+
+ddc_result_t ddc_refresh_wait(TickType_t timeout) {
+  // left set for every waiter, only cleared when the next wait starts
+  xEventGroupClearBits(read_events, DDC_EVENT_OK | DDC_EVENT_FAILED);
+  ddc_refresh();
+
+  EventBits_t bits =
+      xEventGroupWaitBits(read_events, DDC_EVENT_OK | DDC_EVENT_FAILED, pdFALSE, pdFALSE, timeout);
+  if (bits & DDC_EVENT_OK) {
+    return DDC_RESULT_OK;
+  } else if (bits & DDC_EVENT_FAILED) {
+    return DDC_RESULT_FAILED;
+  }
 
-  return address;
+  return DDC_RESULT_TIMEOUT;
 }
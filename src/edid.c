@@ -0,0 +1,200 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "edid.h"
+
+#define EDID_DESCRIPTOR_OFFSET (54)
+#define EDID_DESCRIPTOR_SIZE (18)
+#define EDID_DESCRIPTOR_END (126)
+#define EDID_DESCRIPTOR_NAME (0xfc)
+#define EDID_EXTENSIONS (126)
+#define EDID_CTA_DTD_START (0x02)
+#define EDID_CTA_FLAGS (0x03)
+#define EDID_CTA_DBC_OFFSET (0x04)
+#define EDID_CTA_TAG_AUDIO (1)
+#define EDID_CTA_TAG_VENDOR (3)
+
+static const uint8_t header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+static const uint8_t ctahdr[2] = {0x02, 0x03};
+static const uint8_t hdmi_oui[3] = {0x03, 0x0c, 0x00};
+static const uint8_t hf_oui[3] = {0xd8, 0x5d, 0xc4};
+
+/**
+ * Decode the manufacturer PNP ID, three 5 bit letters where 1 is 'A'.
+ */
+static void decode_manufacturer(const uint8_t *block, char manufacturer[4]) {
+  uint16_t id = (block[8] << 8) | block[9];
+
+  manufacturer[0] = '@' + ((id >> 10) & 0x1f);
+  manufacturer[1] = '@' + ((id >> 5) & 0x1f);
+  manufacturer[2] = '@' + (id & 0x1f);
+  manufacturer[3] = '\0';
+}
+
+/**
+ * Find the monitor name in the block 0 display descriptors.
+ */
+static void decode_name(const uint8_t *block, char name[EDID_NAME_LENGTH + 1]) {
+  for (unsigned int d = EDID_DESCRIPTOR_OFFSET; d < EDID_DESCRIPTOR_END;
+       d += EDID_DESCRIPTOR_SIZE) {
+    const uint8_t *desc = &block[d];
+    if (desc[0] != 0x00 || desc[1] != 0x00 || desc[3] != EDID_DESCRIPTOR_NAME) {
+      continue;
+    }
+
+    // terminated by a line feed, padded with spaces
+    unsigned int len = 0;
+    for (; len < EDID_NAME_LENGTH && desc[5 + len] != '\n'; len++) {
+      uint8_t c = desc[5 + len];
+      name[len] = (c >= 0x20 && c < 0x7f) ? c : '?';
+    }
+    while (len > 0 && name[len - 1] == ' ') {
+      len--;
+    }
+    name[len] = '\0';
+    return;
+  }
+}
+
+/**
+ * Decode a vendor specific data block, len is the payload length.
+ */
+static void parse_vsdb(edid_info_t *info, const uint8_t *db, size_t len) {
+  if (len < 3) {
+    return;
+  }
+
+  if (memcmp(&db[1], hdmi_oui, 3) == 0) {
+    // HDMI Licensing, LLC block, physical address follows the OUI
+    if (len >= 5) {
+      info->physical_address = (db[4] << 8) | db[5];
+    }
+    if (len >= 6) {
+      info->supports_ai = (db[6] & 0x80) != 0;
+    }
+    if (len >= 7 && (db[7] * 5) > info->max_tmds_mhz) {
+      info->max_tmds_mhz = db[7] * 5;
+    }
+  } else if (memcmp(&db[1], hf_oui, 3) == 0) {
+    // HDMI Forum block, max TMDS character rate follows the version
+    if (len >= 5 && (db[5] * 5) > info->max_tmds_mhz) {
+      info->max_tmds_mhz = db[5] * 5;
+    }
+  }
+}
+
+/**
+ * Decode an audio data block, a list of 3 byte short audio descriptors.
+ */
+static void parse_audio(edid_info_t *info, const uint8_t *db, size_t len) {
+  for (size_t i = 1; (i + 2) <= len; i += 3) {
+    uint8_t code = (db[i] >> 3) & 0x0f;
+    uint8_t channels = (db[i] & 0x07) + 1;
+
+    info->audio_formats |= 1 << code;
+    if (channels > info->audio_channels) {
+      info->audio_channels = channels;
+    }
+  }
+}
+
+/**
+ * Scan the data block collection of a CTA extension.
+ */
+static void parse_cta(edid_info_t *info, const uint8_t *cta) {
+  if (cta[EDID_CTA_FLAGS] & 0x40) {
+    info->basic_audio = true;
+  }
+
+  // data blocks end at the first DTD, or the checksum if there are none
+  uint8_t end = cta[EDID_CTA_DTD_START];
+  if (end == 0x00 || end > (EDID_BLOCK_SIZE - 1)) {
+    end = EDID_BLOCK_SIZE - 1;
+  }
+
+  for (uint8_t i = EDID_CTA_DBC_OFFSET; i < end;) {
+    const uint8_t *db = &cta[i];
+    uint8_t tag = db[0] >> 5;
+    uint8_t len = (db[0] & 0x1f);
+    if (len == 0x00) {
+      i++;
+      continue;
+    }
+
+    if ((i + len) >= end) {
+      // truncated data block
+      break;
+    }
+
+    if (tag == EDID_CTA_TAG_AUDIO) {
+      parse_audio(info, db, len);
+    } else if (tag == EDID_CTA_TAG_VENDOR) {
+      parse_vsdb(info, db, len);
+    }
+
+    i += len + 1;  // payload + header
+  }
+}
+
+void edid_parser_init(edid_parser_t *parser) {
+  memset(parser, 0, sizeof(*parser));
+  parser->blocks = 1;
+}
+
+bool edid_decode_identity(const uint8_t block[EDID_BLOCK_SIZE], edid_identity_t *identity) {
+  if (memcmp(block, header, 8)) {
+    return false;
+  }
+
+  decode_manufacturer(block, identity->manufacturer);
+
+  identity->product = block[10] | (block[11] << 8);
+  identity->serial = block[12] | (block[13] << 8) | (block[14] << 16) | ((uint32_t)block[15] << 24);
+  identity->week = block[16];
+  identity->year = 1990 + block[17];
+  identity->version = block[18];
+  identity->revision = block[19];
+  identity->extensions = block[EDID_EXTENSIONS];
+
+  return true;
+}
+
+bool edid_has_audio(const edid_info_t *info) {
+  return info->basic_audio || info->audio_formats != 0;
+}
+
+bool edid_checksum_ok(const uint8_t block[EDID_BLOCK_SIZE]) {
+  uint8_t cksum = 0x00;
+
+  for (size_t i = 0; i < EDID_BLOCK_SIZE; i++) {
+    cksum += block[i];
+  }
+
+  return cksum == 0x00;
+}
+
+edid_parse_t edid_parse_block(edid_parser_t *parser, unsigned int index,
+                              const uint8_t block[EDID_BLOCK_SIZE]) {
+  if (index == 0) {
+    if (memcmp(block, header, 8)) {
+      // not an EDID block
+      return EDID_PARSE_ERROR;
+    }
+
+    decode_manufacturer(block, parser->info.manufacturer);
+    decode_name(block, parser->info.name);
+
+    parser->blocks = 1 + block[EDID_EXTENSIONS];
+    if (parser->blocks == 1) {
+      return EDID_PARSE_DONE;
+    }
+  } else if (memcmp(block, ctahdr, 2) == 0) {
+    // Valid CTA extension block
+    parse_cta(&parser->info, block);
+    if (parser->info.physical_address != 0x0000) {
+      return EDID_PARSE_DONE;
+    }
+  }
+
+  return (index + 1) < parser->blocks ? EDID_PARSE_MORE : EDID_PARSE_DONE;
+}
@@ -31,17 +31,15 @@
 
 #include "common/tusb_common.h"
 
-#include "ws2812.h"
+#include "crashlog.h"
 
 void vApplicationStackOverflowHook(xTaskHandle pxTask, char *pcTaskName) {
   (void)pxTask;
-  (void)pcTaskName;
-
-  // solid red on RGB to indicate overflow
-  ws2812_put_rgb(0x78, 0, 0);
 
   taskDISABLE_INTERRUPTS();
-  TU_ASSERT(false, );
+
+  // record, indicate (solid red) and reboot
+  crashlog_stack_overflow(pcTaskName);
 }
 
 /* configSUPPORT_STATIC_ALLOCATION is set to 1, so the application must provide an
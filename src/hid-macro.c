@@ -0,0 +1,111 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "hid-macro.h"
+
+static void key_down(hid_macro_t *macro, uint8_t key) {
+  for (unsigned int i = 0; i < sizeof(macro->keycode); i++) {
+    if (macro->keycode[i] == key) {
+      return;
+    }
+  }
+
+  for (unsigned int i = 0; i < sizeof(macro->keycode); i++) {
+    if (macro->keycode[i] == 0x00) {
+      macro->keycode[i] = key;
+      return;
+    }
+  }
+}
+
+static void key_up(hid_macro_t *macro, uint8_t key) {
+  for (unsigned int i = 0; i < sizeof(macro->keycode); i++) {
+    if (macro->keycode[i] == key) {
+      macro->keycode[i] = 0x00;
+    }
+  }
+}
+
+bool hid_macro_start(hid_macro_t *macro, const uint8_t code[HID_MACRO_LENGTH]) {
+  if (code[0] == HID_MACRO_OP_END) {
+    return false;
+  }
+
+  memset(macro, 0, sizeof(*macro));
+  memcpy(macro->code, code, sizeof(macro->code));
+  macro->repeat_pc = UINT8_MAX;
+
+  return true;
+}
+
+int32_t hid_macro_step(hid_macro_t *macro, bool *report) {
+  *report = false;
+
+  while (macro->pc < HID_MACRO_LENGTH) {
+    const uint8_t *code = &macro->code[macro->pc];
+    // operand bytes available after the opcode
+    unsigned int avail = HID_MACRO_LENGTH - macro->pc - 1;
+
+    switch ((hid_macro_op_t)code[0]) {
+      case HID_MACRO_OP_DOWN:
+        if (avail < 1) {
+          break;
+        }
+        key_down(macro, code[1]);
+        macro->pc += 2;
+        *report = true;
+        return 0;
+      case HID_MACRO_OP_UP:
+        if (avail < 1) {
+          break;
+        }
+        key_up(macro, code[1]);
+        macro->pc += 2;
+        *report = true;
+        return 0;
+      case HID_MACRO_OP_MOD:
+        if (avail < 1) {
+          break;
+        }
+        macro->modifier = code[1];
+        macro->pc += 2;
+        *report = true;
+        return 0;
+      case HID_MACRO_OP_DELAY:
+        if (avail < 2) {
+          break;
+        }
+        macro->pc += 3;
+        return (code[2] << 8) | code[1];
+      case HID_MACRO_OP_REPEAT:
+        if (avail < 1) {
+          break;
+        }
+        if (macro->repeat_pc == UINT8_MAX) {
+          macro->repeat_pc = macro->pc;
+          macro->repeat = code[1];
+        }
+        if (macro->repeat_pc == macro->pc && macro->repeat > 0) {
+          macro->repeat--;
+          macro->pc = 0;
+        } else {
+          macro->pc += 2;
+        }
+        continue;
+      case HID_MACRO_OP_END:
+      default:
+        break;
+    }
+
+    // end of program or malformed instruction
+    break;
+  }
+
+  // release everything on completion
+  macro->pc = HID_MACRO_LENGTH;
+  macro->modifier = 0x00;
+  memset(macro->keycode, 0, sizeof(macro->keycode));
+  *report = true;
+
+  return -1;
+}
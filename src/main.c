@@ -8,10 +8,15 @@
 #include "pico-cec/config.h"
 
 #include "blink.h"
+#include "cec-config.h"
 #include "cec-frame.h"
 #include "cec-log.h"
 #include "cec-task.h"
+#include "crashlog.h"
+#include "ddc.h"
+#include "nvs.h"
 #include "usb-cdc.h"
+#include "usb_descriptors.h"
 #include "usb_hid.h"
 #include "ws2812.h"
 
@@ -20,21 +25,24 @@ int main() {
   static uint8_t storageCECQueue[CEC_QUEUE_LENGTH * sizeof(uint8_t)];
 
   static StackType_t stackLED[LED_STACK_SIZE];
-  static StackType_t stackCEC[CEC_STACK_SIZE];
+  static StackType_t stackCEC[CEC_BUS_COUNT][CEC_STACK_SIZE];
   static StackType_t stackHID[HID_STACK_SIZE];
   static StackType_t stackCDC[CDC_STACK_SIZE];
   static StackType_t stackUSB[USB_STACK_SIZE];
 
   static StaticTask_t xLEDTCB;
-  static StaticTask_t xCECTCB;
+  static StaticTask_t xCECTCB[CEC_BUS_COUNT];
   static StaticTask_t xHIDTCB;
   static StaticTask_t xUSBTCB;
   static StaticTask_t xCDCTCB;
 
+  static TaskHandle_t xCECTask[CEC_BUS_COUNT];
   static TaskHandle_t xUSBTask;
   static TaskHandle_t xHIDTask;
   static TaskHandle_t xCDCTask;
 
+  crashlog_init();
+
   blink_init();
 
   stdio_init_all();
@@ -42,14 +50,29 @@ int main() {
 
   alarm_pool_init_default();
 
+  // load the live configuration before any task uses it
+  nvs_init();
+  cec_config_init();
+
+  // before usb_task enumerates
+  cec_config_t config;
+  cec_config_get(&config);
+  usb_descriptors_set_hid_interval(config.hid_interval_ms);
+
   // HID key queue
   QueueHandle_t cec_q;
   cec_q = xQueueCreateStatic(CEC_QUEUE_LENGTH, sizeof(uint8_t), &storageCECQueue[0], &xCECQueue);
 
   xBlinkTask = xTaskCreateStatic(blink_task, LED_TASK_NAME, LED_STACK_SIZE, NULL, LED_PRIORITY,
                                  &stackLED[0], &xLEDTCB);
-  xCECTask = xTaskCreateStatic(cec_task, CEC_TASK_NAME, CEC_STACK_SIZE, &cec_q, CEC_PRIORITY,
-                               &stackCEC[0], &xCECTCB);
+  // one CEC task per bus, all sending keys with usb_hid_send_key()
+  static const char *const cec_names[] = {CEC_TASK_NAME, CEC_TASK_NAME_2};
+  static cec_task_param_t cec_params[CEC_BUS_COUNT];
+  for (unsigned int i = 0; i < CEC_BUS_COUNT; i++) {
+    cec_params[i].bus = i;
+    xCECTask[i] = xTaskCreateStatic(cec_task, cec_names[i], CEC_STACK_SIZE, &cec_params[i],
+                                    CEC_PRIORITY, &stackCEC[i][0], &xCECTCB[i]);
+  }
   xHIDTask = xTaskCreateStatic(hid_task, HID_TASK_NAME, HID_STACK_SIZE, &cec_q, HID_PRIORITY,
                                &stackHID[0], &xHIDTCB);
   xUSBTask = xTaskCreateStatic(usb_task, USB_TASK_NAME, USB_STACK_SIZE, NULL, USB_PRIORITY,
@@ -63,7 +86,9 @@ int main() {
   (void)xUSBTask;
   (void)xCDCTask;
 
+  cdc_init();
   cec_log_init(cdc_log);
+  ddc_init();
 
   vTaskStartScheduler();
 
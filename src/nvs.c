@@ -1,14 +1,26 @@
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
 #include <hardware/flash.h>
-#include <hardware/sync.h>
 
 #include "crc/crc32.h"
 
 #include "cec-config.h"
+#include "cec-frame.h"
+#include "cec-log.h"
 #include "nvs.h"
 
+/** CEC bus idle time required before a flash operation, 7 bit periods. */
+#define NVS_BUS_IDLE_US (7 * 2400)
+
+/** Give up waiting for an idle bus and write anyway after this long. */
+#define NVS_BUS_IDLE_TIMEOUT_MS (1000)
+
 /**
  * Configuration header block, fixed size (40 bytes).
  *
@@ -40,6 +52,8 @@ typedef struct __attribute__((packed)) {
 /**
  * CEC configuration block NVS representation.
  *
+ * From version 2 onwards, new fields are only ever appended.
+ *
  * Structure is packed to ensure checksum correctness.
  */
 typedef struct __attribute__((packed)) {
@@ -60,14 +74,21 @@ typedef struct __attribute__((packed)) {
 
   /** User Control key mapping table. */
   uint8_t keymap[UINT8_MAX];
+
+  /** HID macro programs (version 3). */
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+  /** HID endpoint polling interval in milliseconds (version 4). */
+  uint8_t hid_interval_ms;
 } cec_config_nvs_t;
 
 /**
- * Serialised at-rest format.
+ * Serialised versioned configuration (versions 1 to 4).
  *
- * Structure is aligned to comply with requirement for page sized flash writes.
+ * This was the whole at-rest format before the record log, a bare copy may
+ * still be found at the start of the region.
  */
-typedef struct __attribute__((aligned(FLASH_PAGE_SIZE))) {
+typedef struct {
   /** Header. */
   cec_config_header_nvs_t header;
 
@@ -81,6 +102,135 @@ typedef struct __attribute__((aligned(FLASH_PAGE_SIZE))) {
   uint32_t config_crc;
 } pico_cec_nvs_t;
 
+/**
+ * In-memory configuration of versions 5 and 6, with the macros inline.
+ *
+ * Version 5 ends before audio_system.
+ */
+typedef struct {
+  uint32_t edid_delay_ms;
+  uint16_t physical_address;
+  uint8_t logical_address;
+  uint8_t device_type;
+  cec_config_keymap_t keymap_type;
+  uint8_t keymap[UINT8_MAX];
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+  uint8_t hid_interval_ms;
+  bool audio_system;
+} cec_config_v6_t;
+
+/**
+ * Versioned configuration of versions 5 and 6.
+ */
+typedef struct {
+  /** Header. */
+  cec_config_header_nvs_t header;
+
+  /** CRC32 of the header block. */
+  uint32_t header_crc;
+
+  /** Configuration. */
+  cec_config_v6_t config;
+
+  /** CRC32 of the config block. */
+  uint32_t config_crc;
+} nvs_config_v6_t;
+
+/**
+ * Versioned configuration (version 5 onwards).
+ *
+ * The body is the in-memory configuration as is, so once validated it can be
+ * used in place from the memory mapped flash. Shares the header layout of
+ * pico_cec_nvs_t so older versions can be told apart and migrated.
+ */
+typedef struct {
+  /** Header. */
+  cec_config_header_nvs_t header;
+
+  /** CRC32 of the header block. */
+  uint32_t header_crc;
+
+  /** Configuration. */
+  cec_config_t config;
+
+  /** CRC32 of the config block. */
+  uint32_t config_crc;
+} nvs_config_t;
+
+_Static_assert(offsetof(nvs_config_t, config) == offsetof(pico_cec_nvs_t, config),
+               "NVS header layout mismatch");
+_Static_assert(offsetof(nvs_config_t, config) == offsetof(nvs_config_v6_t, config),
+               "NVS header layout mismatch");
+
+/**
+ * EDID cache record body.
+ */
+typedef struct {
+  /** Fingerprint of the last sink. */
+  nvs_edid_t edid;
+
+  /** CRC32 of the fingerprint. */
+  uint32_t edid_crc;
+} nvs_edid_cache_t;
+
+/**
+ * HID macro record body.
+ *
+ * Macros were part of the configuration up to version 6, they have their own
+ * record so the copies of cec_config_t held by each task stay small.
+ */
+typedef struct {
+  /** Macro programs. */
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+  /** CRC32 of the macro programs. */
+  uint32_t macros_crc;
+} nvs_macros_t;
+
+/**
+ * Log record.
+ *
+ * The NVS region is used as a ring of fixed size record slots which are only
+ * ever appended to, the valid record of each type with the highest sequence
+ * number is current. A sector is erased only when the log moves into it, and
+ * only if it holds nothing but superseded records, otherwise it is skipped.
+ *
+ * Structure is aligned to comply with requirement for page sized flash writes.
+ */
+typedef struct __attribute__((aligned(FLASH_PAGE_SIZE))) {
+  /** Record type, distinguishes a record from erased or legacy flash. */
+  uint32_t magic;
+
+  /** Sequence number, incremented on every save of any type. */
+  uint32_t sequence;
+
+  /** CRC32 of the magic and sequence number. */
+  uint32_t sequence_crc;
+
+  union {
+    /** Configuration (NVS_RECORD_MAGIC). */
+    nvs_config_t nvs;
+
+    /** EDID cache (NVS_EDID_MAGIC). */
+    nvs_edid_cache_t cache;
+
+    /** HID macros (NVS_MACRO_MAGIC). */
+    nvs_macros_t macros;
+
+    /** Configuration of versions 5 and 6, also keeps the slot size they used. */
+    nvs_config_v6_t nvs_v6;
+  };
+} nvs_record_t;
+
+#define NVS_RECORD_MAGIC (0x4e565352)  // "NVSR"
+#define NVS_EDID_MAGIC (0x4e565345)    // "NVSE"
+#define NVS_MACRO_MAGIC (0x4e56534d)   // "NVSM"
+
+/** Record slots per flash sector, records never span a sector. */
+#define NVS_SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / sizeof(nvs_record_t))
+
+_Static_assert(NVS_SLOTS_PER_SECTOR > 0, "NVS record larger than a flash sector");
+
 // Symbols resolved from link script
 extern uint32_t CEC_NVS_BASE_ADDR[];
 extern uint32_t __CEC_NVS_LEN[];
@@ -88,13 +238,96 @@ extern uint32_t __CEC_NVS_LEN[];
 #define CEC_NVS_LEN ((uint32_t)(&__CEC_NVS_LEN))
 
 const uint8_t CEC_CONFIG_VERSION_01 = 0x01;
-const uint8_t CEC_CONFIG_VERSION = 0x02;
+const uint8_t CEC_CONFIG_VERSION_02 = 0x02;
+const uint8_t CEC_CONFIG_VERSION_03 = 0x03;
+const uint8_t CEC_CONFIG_VERSION_04 = 0x04;
+const uint8_t CEC_CONFIG_VERSION_05 = 0x05;
+const uint8_t CEC_CONFIG_VERSION_06 = 0x06;
+const uint8_t CEC_CONFIG_VERSION = 0x07;
 const size_t CEC_CONFIG_SIZE = sizeof(cec_config_t);
 
+/** Newest valid stored configuration, validated once at boot. */
+static const nvs_config_t *stored = NULL;
+static bool validated = false;
+
+/** Slot of the newest valid EDID cache record, -1 if none. */
+static int edid_slot = -1;
+static bool edid_validated = false;
+
+/** Slot of the newest valid macro record, -1 if none. */
+static int macro_slot = -1;
+static bool macro_validated = false;
+
+/**
+ * Serialises validation and writers, the record and the validation scratch
+ * configuration are too large for their stacks.
+ */
+static SemaphoreHandle_t nvs_mutex;
+static StaticSemaphore_t nvs_mutex_static;
+static nvs_record_t pending;
+static cec_config_t scratch;
+
 static uint32_t nvs_get_flash_address(void) {
   return ((uint32_t)CEC_NVS_BASE_ADDR - XIP_BASE);
 }
 
+static unsigned int slot_count(void) {
+  return (CEC_NVS_LEN / FLASH_SECTOR_SIZE) * NVS_SLOTS_PER_SECTOR;
+}
+
+/**
+ * Offset of a record slot from the start of the NVS region.
+ */
+static uint32_t slot_offset(unsigned int slot) {
+  return (slot / NVS_SLOTS_PER_SECTOR) * FLASH_SECTOR_SIZE +
+         (slot % NVS_SLOTS_PER_SECTOR) * sizeof(nvs_record_t);
+}
+
+static const nvs_record_t *record_at(unsigned int slot) {
+  // flash is mmapped for read
+  return (const nvs_record_t *)((const uint8_t *)CEC_NVS_BASE_ADDR + slot_offset(slot));
+}
+
+static bool is_erased(const void *flash, size_t len) {
+  const uint8_t *p = flash;
+
+  for (size_t i = 0; i < len; i++) {
+    if (p[i] != 0xff) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Find the record of a type with the highest sequence number below limit.
+ *
+ * Only the record header is checked, so this is cheap enough to run over the
+ * whole region. Returns the slot index or -1 if there is none.
+ */
+static int find_record(uint32_t magic, uint32_t limit) {
+  int found = -1;
+  uint32_t sequence = 0;
+
+  for (unsigned int slot = 0; slot < slot_count(); slot++) {
+    const nvs_record_t *record = record_at(slot);
+
+    if (record->magic != magic || record->sequence >= limit ||
+        (found >= 0 && record->sequence <= sequence)) {
+      continue;
+    }
+
+    if (crc32((unsigned char *)record, offsetof(nvs_record_t, sequence_crc)) ==
+        record->sequence_crc) {
+      found = slot;
+      sequence = record->sequence;
+    }
+  }
+
+  return found;
+}
+
 /**
  * Migrate v1 config to current config.
  */
@@ -104,9 +337,7 @@ static bool migrate_v1(const pico_cec_nvs_t *nvs, cec_config_t *config) {
     // deserialise and migrate
     config->edid_delay_ms = configv1->edid_delay_ms;
     config->physical_address = configv1->physical_address;
-    for (uint8_t n = 0; n < UINT8_MAX; n++) {
-      config->keymap[n].key = configv1->keymap[n];
-    }
+    memcpy(config->keymap, configv1->keymap, sizeof(config->keymap));
 
     return true;
   }
@@ -114,11 +345,70 @@ static bool migrate_v1(const pico_cec_nvs_t *nvs, cec_config_t *config) {
   return false;
 }
 
+// the config CRC directly follows the v5 and v6 bodies
+_Static_assert((offsetof(cec_config_v6_t, audio_system) % 4) == 0, "NVS v5 body size mismatch");
+_Static_assert((sizeof(cec_config_v6_t) % 4) == 0, "NVS v6 body size mismatch");
+
 /**
- * Load current config.
+ * Migrate v5 or v6 config, the in-memory configuration with the macros inline.
+ *
+ * The macros are left in place, they are read by nvs_read_macros() until the
+ * first save moves them to their own record. The record slot size did not
+ * change, so these records are still found in place.
  */
-static bool load_config(pico_cec_nvs_t *nvs, cec_config_t *config) {
-  if (crc32((unsigned char *)&nvs->config, sizeof(nvs->config)) == nvs->config_crc) {
+static bool migrate_v6(const nvs_config_v6_t *nvs, size_t size, cec_config_t *config) {
+  const unsigned char *body = (const unsigned char *)&nvs->config;
+  uint32_t crc;
+
+  if (nvs->header.length != size) {
+    return false;
+  }
+
+  memcpy(&crc, &body[size], sizeof(crc));
+  if (crc32(body, size) == crc) {
+    config->edid_delay_ms = nvs->config.edid_delay_ms;
+    config->physical_address = nvs->config.physical_address;
+    config->logical_address = nvs->config.logical_address;
+    config->device_type = nvs->config.device_type;
+    config->keymap_type = nvs->config.keymap_type;
+    memcpy(config->keymap, nvs->config.keymap, sizeof(config->keymap));
+    config->hid_interval_ms = nvs->config.hid_interval_ms;
+    if (size > offsetof(cec_config_v6_t, audio_system)) {
+      config->audio_system = nvs->config.audio_system;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * Size of the configuration body stored by each version.
+ */
+static size_t config_size(uint8_t version) {
+  if (version == CEC_CONFIG_VERSION_02) {
+    return offsetof(cec_config_nvs_t, macros);
+  } else if (version == CEC_CONFIG_VERSION_03) {
+    return offsetof(cec_config_nvs_t, hid_interval_ms);
+  } else if (version == CEC_CONFIG_VERSION_04) {
+    return sizeof(cec_config_nvs_t);
+  }
+
+  return 0;
+}
+
+/**
+ * Load current config, or an older version lacking the newest fields.
+ *
+ * Fields beyond the stored size keep their default values.
+ */
+static bool load_config(const pico_cec_nvs_t *nvs, size_t size, cec_config_t *config) {
+  const unsigned char *body = (const unsigned char *)&nvs->config;
+  uint32_t crc;
+
+  // the config CRC follows the word aligned body of the stored version
+  memcpy(&crc, &body[(size + 3) & ~3], sizeof(crc));
+  if (crc32(body, size) == crc) {
     // deserialise
     config->edid_delay_ms = nvs->config.edid_delay_ms;
     config->physical_address = nvs->config.physical_address;
@@ -129,8 +419,9 @@ static bool load_config(pico_cec_nvs_t *nvs, cec_config_t *config) {
       config->device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
     }
     config->keymap_type = nvs->config.keymap_type;
-    for (uint8_t n = 0; n < UINT8_MAX; n++) {
-      config->keymap[n].key = nvs->config.keymap[n];
+    memcpy(config->keymap, nvs->config.keymap, sizeof(config->keymap));
+    if (size > offsetof(cec_config_nvs_t, hid_interval_ms)) {
+      config->hid_interval_ms = nvs->config.hid_interval_ms;
     }
 
     return true;
@@ -139,25 +430,131 @@ static bool load_config(pico_cec_nvs_t *nvs, cec_config_t *config) {
   return false;
 }
 
-bool nvs_read_config(cec_config_t *config) {
-  bool success = false;
+/**
+ * Check a versioned configuration, and migrate if it is an older version.
+ *
+ * The current version is only checked, config may be NULL. Older versions are
+ * deserialised and migrated into config.
+ */
+static bool check_nvs(const nvs_config_t *nvs, cec_config_t *config) {
+  // read and check header/config CRCs
+  if (crc32((unsigned char *)&nvs->header, sizeof(nvs->header)) != nvs->header_crc) {
+    return false;
+  }
 
-  // flash is mmapped for read
-  pico_cec_nvs_t *cec_nvs = (pico_cec_nvs_t *)(CEC_NVS_BASE_ADDR);
+  if (nvs->header.version == CEC_CONFIG_VERSION) {
+    return nvs->header.length == CEC_CONFIG_SIZE &&
+           crc32((unsigned char *)&nvs->config, sizeof(nvs->config)) == nvs->config_crc;
+  }
+
+  if (config == NULL) {
+    return false;
+  }
+
+  const pico_cec_nvs_t *legacy = (const pico_cec_nvs_t *)nvs;
+  const nvs_config_v6_t *inline_macros = (const nvs_config_v6_t *)nvs;
+  if (nvs->header.version == CEC_CONFIG_VERSION_01) {
+    return migrate_v1(legacy, config);
+  } else if (nvs->header.version == CEC_CONFIG_VERSION_05) {
+    return migrate_v6(inline_macros, offsetof(cec_config_v6_t, audio_system), config);
+  } else if (nvs->header.version == CEC_CONFIG_VERSION_06) {
+    return migrate_v6(inline_macros, sizeof(cec_config_v6_t), config);
+  } else {
+    size_t size = config_size(nvs->header.version);
+    if (size > 0) {
+      return load_config(legacy, size, config);
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Find the newest valid configuration, once.
+ *
+ * A record of the current version is only checked, an older version is
+ * migrated into config as it is found.
+ */
+static void validate(cec_config_t *config) {
+  if (validated) {
+    return;
+  }
+  validated = true;
+
+  // newest record first, falling back past any interrupted by a power loss
+  for (int slot = find_record(NVS_RECORD_MAGIC, UINT32_MAX); slot >= 0;
+       slot = find_record(NVS_RECORD_MAGIC, record_at(slot)->sequence)) {
+    const nvs_record_t *record = record_at(slot);
+
+    if (check_nvs(&record->nvs, config)) {
+      CEC_LOG_INFO(CEC_LOG_NVS, "Found record %lu in slot %d",
+                   (unsigned long)record->sequence, slot);
+      stored = &record->nvs;
+      return;
+    }
+
+    CEC_LOG_WARN(CEC_LOG_NVS, "Damaged record %lu in slot %d",
+                 (unsigned long)record->sequence, slot);
+  }
+
+  // config saved before the record log, stored bare at the start of the region
+  if (check_nvs((const nvs_config_t *)CEC_NVS_BASE_ADDR, config)) {
+    CEC_LOG_INFO(CEC_LOG_NVS, "Found legacy config");
+    stored = (const nvs_config_t *)CEC_NVS_BASE_ADDR;
+  }
+}
+
+/**
+ * Stored configuration of the current version, called with nvs_mutex held.
+ */
+static const cec_config_t *get_config(void) {
+  if (!validated) {
+    // an older version found here is simply not usable in place
+    validate(&scratch);
+  }
+
+  if (stored != NULL && stored->header.version == CEC_CONFIG_VERSION) {
+    return &stored->config;
+  }
+
+  return NULL;
+}
+
+const cec_config_t *nvs_get_config(void) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+  const cec_config_t *config = get_config();
+  xSemaphoreGive(nvs_mutex);
+
+  return config;
+}
 
+bool nvs_read_config(cec_config_t *config) {
   // start with default config, then overlay from nvs
   cec_config_set_default(config);
 
-  // read and check header/config CRCs
-  if (crc32((unsigned char *)&cec_nvs->header, sizeof(cec_nvs->header)) == cec_nvs->header_crc) {
-    if (cec_nvs->header.version == CEC_CONFIG_VERSION_01) {
-      success = migrate_v1(cec_nvs, config);
-    } else if (cec_nvs->header.version == CEC_CONFIG_VERSION) {
-      success = load_config(cec_nvs, config);
-    }
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  if (!validated) {
+    // migrates an older version into config as a side effect
+    validate(config);
+  } else if (stored != NULL && stored->header.version != CEC_CONFIG_VERSION) {
+    check_nvs(stored, config);
+  }
+
+  if (stored != NULL && stored->header.version == CEC_CONFIG_VERSION) {
+    memcpy(config, &stored->config, sizeof(*config));
+  }
+
+  if (stored != NULL) {
+    CEC_LOG_INFO(CEC_LOG_NVS, "Loaded config version 0x%02x", stored->header.version);
+  } else {
+    CEC_LOG_WARN(CEC_LOG_NVS, "No valid config, using defaults");
   }
+  bool found = stored != NULL;
 
-  return success;
+  xSemaphoreGive(nvs_mutex);
+
+  return found;
 }
 
 void nvs_load_config(cec_config_t *config) {
@@ -175,49 +572,351 @@ void nvs_load_config(cec_config_t *config) {
       break;
   }
 
-  cec_config_complete(config);
-
   return;
 }
 
-bool nvs_save_config(const cec_config_t *config) {
-  pico_cec_nvs_t cec_nvs = {0x0};
+/**
+ * Start a flash operation once the CEC bus is idle.
+ *
+ * The image runs from RAM (copy_to_ram) and no interrupt handler touches
+ * flash, so interrupts are left enabled and the CEC PHY keeps its timing.
+ * Only the scheduler is suspended, to keep tasks off the flash while it is
+ * not mapped. Waiting for an idle bus keeps cec_task from being stalled in
+ * the middle of a transaction.
+ */
+static void flash_begin(void) {
+  TickType_t start = xTaskGetTickCount();
 
-  if (sizeof(cec_nvs) > CEC_NVS_LEN) {
-    return false;
+  while (true) {
+    vTaskSuspendAll();
+    if (cec_frame_idle_us() >= NVS_BUS_IDLE_US) {
+      break;
+    }
+    xTaskResumeAll();
+
+    if ((xTaskGetTickCount() - start) > pdMS_TO_TICKS(NVS_BUS_IDLE_TIMEOUT_MS)) {
+      CEC_LOG_WARN(CEC_LOG_NVS, "CEC bus busy, writing anyway");
+      vTaskSuspendAll();
+      break;
+    }
+    vTaskDelay(1);
   }
 
+  cec_frame_flash_begin();
+}
+
+static void flash_end(void) {
+  cec_frame_flash_end();
+  xTaskResumeAll();
+}
+
+static void serialise(const cec_config_t *config, nvs_config_t *nvs) {
   // serialise and checksum header
-  cec_nvs.header.version = CEC_CONFIG_VERSION;
-  cec_nvs.header.length = CEC_CONFIG_SIZE;
-  cec_nvs.header_crc = crc32((unsigned char *)&cec_nvs.header, sizeof(cec_nvs.header));
+  nvs->header.version = CEC_CONFIG_VERSION;
+  nvs->header.length = CEC_CONFIG_SIZE;
+  nvs->header_crc = crc32((unsigned char *)&nvs->header, sizeof(nvs->header));
 
-  // serialise and checksum config
-  cec_nvs.config.edid_delay_ms = config->edid_delay_ms;
-  cec_nvs.config.physical_address = config->physical_address;
-  cec_nvs.config.logical_address = config->logical_address;
-  cec_nvs.config.device_type = config->device_type;
-  cec_nvs.config.keymap_type = config->keymap_type;
+  // checksum config, stored as is
+  memcpy(&nvs->config, config, sizeof(nvs->config));
+  nvs->config_crc = crc32((unsigned char *)&nvs->config, sizeof(nvs->config));
+}
 
-  for (unsigned int n = 0; n < UINT8_MAX; n++) {
-    cec_nvs.config.keymap[n] = config->keymap[n].key;
+/**
+ * Find the newest valid EDID cache record, once.
+ */
+static void validate_edid(void) {
+  if (edid_validated) {
+    return;
   }
+  edid_validated = true;
 
-  cec_nvs.config_crc = crc32((unsigned char *)&cec_nvs.config, sizeof(cec_nvs.config));
+  for (int slot = find_record(NVS_EDID_MAGIC, UINT32_MAX); slot >= 0;
+       slot = find_record(NVS_EDID_MAGIC, record_at(slot)->sequence)) {
+    const nvs_edid_cache_t *cache = &record_at(slot)->cache;
 
-  // minimum number of flash sectors to erase in bytes
-  unsigned int n = sizeof(cec_nvs) / FLASH_SECTOR_SIZE;
-  unsigned int size = sizeof(cec_nvs) % FLASH_SECTOR_SIZE == 0 ? n * FLASH_SECTOR_SIZE
-                                                               : (n + 1) * FLASH_SECTOR_SIZE;
+    if (crc32((unsigned char *)&cache->edid, sizeof(cache->edid)) == cache->edid_crc) {
+      edid_slot = slot;
+      return;
+    }
+  }
+}
 
-  // interrupts must be disabled to safely program flash
-  uint32_t irqs = save_and_disable_interrupts();
-  flash_range_erase(nvs_get_flash_address(), size);
+/**
+ * Find the newest valid macro record, once.
+ */
+static void validate_macros(void) {
+  if (macro_validated) {
+    return;
+  }
+  macro_validated = true;
 
-  // struct alignment should guarantee flash pages multiples
-  flash_range_program(nvs_get_flash_address(), (uint8_t *)&cec_nvs, sizeof(cec_nvs));
+  for (int slot = find_record(NVS_MACRO_MAGIC, UINT32_MAX); slot >= 0;
+       slot = find_record(NVS_MACRO_MAGIC, record_at(slot)->sequence)) {
+    const nvs_macros_t *macros = &record_at(slot)->macros;
 
-  restore_interrupts(irqs);
+    if (crc32((unsigned char *)macros->macros, sizeof(macros->macros)) == macros->macros_crc) {
+      macro_slot = slot;
+      return;
+    }
+  }
+}
 
-  return true;
+/**
+ * Macros held inline by an older stored configuration, NULL if there are none.
+ *
+ * Called with nvs_mutex held, once the configuration is validated.
+ */
+static const uint8_t *legacy_macros(void) {
+  if (stored == NULL) {
+    return NULL;
+  }
+
+  uint8_t version = stored->header.version;
+  if (version == CEC_CONFIG_VERSION_03 || version == CEC_CONFIG_VERSION_04) {
+    return &((const pico_cec_nvs_t *)stored)->config.macros[0][0];
+  } else if (version == CEC_CONFIG_VERSION_05 || version == CEC_CONFIG_VERSION_06) {
+    return &((const nvs_config_v6_t *)stored)->config.macros[0][0];
+  }
+
+  return NULL;
+}
+
+/**
+ * Current macros, from their own record or an older configuration.
+ */
+static const uint8_t *current_macros(void) {
+  if (macro_slot >= 0) {
+    return &record_at(macro_slot)->macros.macros[0][0];
+  }
+
+  return legacy_macros();
+}
+
+/**
+ * Sector of the NVS region holding the memory mapped flash address.
+ */
+static unsigned int sector_of(const void *flash) {
+  return ((const uint8_t *)flash - (const uint8_t *)CEC_NVS_BASE_ADDR) / FLASH_SECTOR_SIZE;
+}
+
+/**
+ * Check if a sector holds a current record of any type (or legacy config).
+ */
+static bool sector_live(unsigned int sector) {
+  if (stored != NULL && sector_of(stored) == sector) {
+    return true;
+  }
+
+  if (macro_slot >= 0 && (macro_slot / NVS_SLOTS_PER_SECTOR) == sector) {
+    return true;
+  }
+
+  return edid_slot >= 0 && (edid_slot / NVS_SLOTS_PER_SECTOR) == sector;
+}
+
+/**
+ * Append the pending record to the log, returns the slot or -1 on failure.
+ *
+ * The caller fills in the body, the header is filled in here.
+ */
+static int append(uint32_t magic, const char *name) {
+  unsigned int count = slot_count();
+  unsigned int sectors = count / NVS_SLOTS_PER_SECTOR;
+  unsigned int slot = 0;
+
+  // the newest record of any type, the log continues after it
+  static const uint32_t magics[] = {NVS_RECORD_MAGIC, NVS_EDID_MAGIC, NVS_MACRO_MAGIC};
+  int latest = -1;
+  for (unsigned int i = 0; i < sizeof(magics) / sizeof(magics[0]); i++) {
+    int found = find_record(magics[i], UINT32_MAX);
+    if (found >= 0 && (latest < 0 || record_at(found)->sequence > record_at(latest)->sequence)) {
+      latest = found;
+    }
+  }
+
+  pending.magic = magic;
+  if (latest >= 0) {
+    slot = (latest + 1) % count;
+    pending.sequence = record_at(latest)->sequence + 1;
+  } else {
+    pending.sequence = 1;
+  }
+
+  // a slot dirtied by an interrupted save cannot be reprogrammed without
+  // erasing the current record too, so move on to the next sector
+  if ((slot % NVS_SLOTS_PER_SECTOR) != 0 && !is_erased(record_at(slot), sizeof(pending))) {
+    slot = ((slot / NVS_SLOTS_PER_SECTOR + 1) * NVS_SLOTS_PER_SECTOR) % count;
+  }
+
+  // on entry to a sector, skip it while it holds a current record
+  if ((slot % NVS_SLOTS_PER_SECTOR) == 0) {
+    for (unsigned int i = 0; i < sectors && sector_live(slot / NVS_SLOTS_PER_SECTOR); i++) {
+      slot = (slot + NVS_SLOTS_PER_SECTOR) % count;
+    }
+
+    // current records of every type must survive the erase
+    if (sector_live(slot / NVS_SLOTS_PER_SECTOR)) {
+      return -1;
+    }
+  }
+
+  // erase only on entry to a sector, which by now holds only stale records
+  bool erase = (slot % NVS_SLOTS_PER_SECTOR) == 0 &&
+               !is_erased(record_at(slot), FLASH_SECTOR_SIZE);
+
+  pending.sequence_crc = crc32((unsigned char *)&pending, offsetof(nvs_record_t, sequence_crc));
+
+  uint32_t offset = nvs_get_flash_address() + slot_offset(slot);
+
+  if (erase) {
+    flash_begin();
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    flash_end();
+  }
+
+  // one page at a time, struct alignment should guarantee flash pages multiples
+  for (size_t page = 0; page < sizeof(pending); page += FLASH_PAGE_SIZE) {
+    flash_begin();
+    flash_range_program(offset + page, (uint8_t *)&pending + page, FLASH_PAGE_SIZE);
+    flash_end();
+  }
+
+  if (memcmp(record_at(slot), &pending, sizeof(pending)) != 0) {
+    CEC_LOG_ERROR(CEC_LOG_NVS, "Verify failed for %s record %lu in slot %u", name,
+                  (unsigned long)pending.sequence, slot);
+    return -1;
+  }
+
+  CEC_LOG_INFO(CEC_LOG_NVS, "Saved %s as record %lu in slot %u%s", name,
+               (unsigned long)pending.sequence, slot, erase ? " (erased)" : "");
+
+  return slot;
+}
+
+void nvs_init(void) {
+  nvs_mutex = xSemaphoreCreateMutexStatic(&nvs_mutex_static);
+}
+
+/**
+ * Append a macro record, called with nvs_mutex held.
+ */
+static int save_macros(const uint8_t *macros) {
+  memset(&pending, 0, sizeof(pending));
+  memcpy(pending.macros.macros, macros, sizeof(pending.macros.macros));
+  pending.macros.macros_crc =
+      crc32((unsigned char *)pending.macros.macros, sizeof(pending.macros.macros));
+  int slot = append(NVS_MACRO_MAGIC, "macros");
+  if (slot >= 0) {
+    macro_slot = slot;
+  }
+
+  return slot;
+}
+
+bool nvs_save_config(const cec_config_t *config) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  // every current record must be known before anything is erased
+  get_config();
+  validate_edid();
+  validate_macros();
+
+  // macros inline in an older configuration get their own record first, the
+  // configuration holding them is about to be superseded
+  int slot = 0;
+  const uint8_t *legacy = legacy_macros();
+  if (macro_slot < 0 && legacy != NULL) {
+    slot = save_macros(legacy);
+  }
+
+  if (slot >= 0) {
+    memset(&pending, 0, sizeof(pending));
+    serialise(config, &pending.nvs);
+    slot = append(NVS_RECORD_MAGIC, "config");
+  }
+  if (slot >= 0) {
+    // verified, so it is the new stored configuration
+    validated = true;
+    stored = &record_at(slot)->nvs;
+  }
+
+  xSemaphoreGive(nvs_mutex);
+
+  return slot >= 0;
+}
+
+bool nvs_read_edid(nvs_edid_t *edid) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  validate_edid();
+  bool found = edid_slot >= 0;
+  if (found) {
+    *edid = record_at(edid_slot)->cache.edid;
+  }
+
+  xSemaphoreGive(nvs_mutex);
+
+  return found;
+}
+
+bool nvs_save_edid(const nvs_edid_t *edid) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  // every current record must be known before anything is erased
+  get_config();
+  validate_edid();
+  validate_macros();
+
+  memset(&pending, 0, sizeof(pending));
+  pending.cache.edid = *edid;
+  pending.cache.edid_crc = crc32((unsigned char *)&pending.cache.edid, sizeof(pending.cache.edid));
+  int slot = append(NVS_EDID_MAGIC, "EDID");
+  if (slot >= 0) {
+    edid_slot = slot;
+  }
+
+  xSemaphoreGive(nvs_mutex);
+
+  return slot >= 0;
+}
+
+bool nvs_read_macros(uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH]) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  get_config();
+  validate_macros();
+  const uint8_t *current = current_macros();
+  if (current != NULL) {
+    memcpy(macros, current, HID_MACRO_COUNT * HID_MACRO_LENGTH);
+  }
+
+  xSemaphoreGive(nvs_mutex);
+
+  return current != NULL;
+}
+
+bool nvs_save_macros(const uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH]) {
+  xSemaphoreTake(nvs_mutex, portMAX_DELAY);
+
+  // every current record must be known before anything is erased
+  get_config();
+  validate_edid();
+  validate_macros();
+
+  // unchanged macros are not written again, none at all need no record
+  bool changed = false;
+  const uint8_t *current = current_macros();
+  if (current != NULL) {
+    changed = memcmp(current, macros, HID_MACRO_COUNT * HID_MACRO_LENGTH) != 0;
+  } else {
+    for (unsigned int i = 0; i < HID_MACRO_COUNT && !changed; i++) {
+      changed = macros[i][0] != HID_MACRO_OP_END;
+    }
+  }
+
+  bool saved = !changed || save_macros(&macros[0][0]) >= 0;
+
+  xSemaphoreGive(nvs_mutex);
+
+  return saved;
 }
@@ -2,6 +2,10 @@
 #include <string.h>
 #include <tusb.h>
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
 #include <hardware/watchdog.h>
 #include <pico/bootrom.h>
 
@@ -11,22 +15,112 @@
 #include "cec-frame.h"
 #include "cec-log.h"
 #include "cec-task.h"
+#include "cec-user.h"
+#include "crashlog.h"
 #include "ddc.h"
+#include "edid.h"
+#include "hid-macro.h"
 #include "nvs.h"
 #include "tclie.h"
 #include "usb-cdc.h"
+#include "usb_descriptors.h"
+#include "usb_hid.h"
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+/** Task notification bits, set from TinyUSB callbacks in usb_task. */
+#define CDC_NOTIFY_RX (1 << 0)
+#define CDC_NOTIFY_TX (1 << 1)
+#define CDC_NOTIFY_LINE (1 << 2)
+
+/** Task notification index used by a writer waiting for TX FIFO space. */
+#define CDC_NOTIFY_INDEX_TX ((UBaseType_t)1)
+
+/** Give up on a host which stops reading for this long. */
+#define CDC_TX_TIMEOUT_MS (100)
+
+/** Maximum length of a formatted string. */
+#define CDC_PRINTF_LENGTH (512)
+
+/** Longest the CLI waits on a HID measurement, slow intervals finish in the background. */
+#define CDC_QUERY_HID_WAIT_MS (3000)
+
+static TaskHandle_t xCDCTask;
+
+/** Serialises output from the CLI and log tasks. */
+static StaticSemaphore_t tx_mutex_static;
+static SemaphoreHandle_t tx_mutex;
+
+/** Writer waiting for TX FIFO space, if any. */
+static volatile TaskHandle_t tx_waiter;
+
 // Copy of configuration
 static cec_config_t config = {0x0};
 
 static tclie_t tclie;
 
+/**
+ * Wait for TinyUSB to drain the TX FIFO.
+ *
+ * Returns false if the host has not read anything within the timeout.
+ */
+static bool wait_tx_space(void) {
+  xTaskNotifyStateClearIndexed(NULL, CDC_NOTIFY_INDEX_TX);
+  tx_waiter = xTaskGetCurrentTaskHandle();
+
+  bool space = (tud_cdc_write_available() > 0);
+  if (!space) {
+    tud_cdc_write_flush();
+    space = (ulTaskNotifyTakeIndexed(CDC_NOTIFY_INDEX_TX, pdTRUE,
+                                     pdMS_TO_TICKS(CDC_TX_TIMEOUT_MS)) > 0);
+  }
+
+  tx_waiter = NULL;
+
+  return space;
+}
+
+/**
+ * Write to the TX FIFO, blocking while it is full.
+ *
+ * Output is flushed to the host on newline, partial lines wait for
+ * cdc_flush() or a full USB packet.
+ */
+static void cdc_write(const char *str, size_t len) {
+  bool newline = (memchr(str, '\n', len) != NULL);
+
+  xSemaphoreTakeRecursive(tx_mutex, portMAX_DELAY);
+  while (len > 0 && tud_cdc_connected()) {
+    uint32_t available = tud_cdc_write_available();
+    if (available == 0) {
+      if (!wait_tx_space()) {
+        // host is not reading, drop the remainder
+        break;
+      }
+      continue;
+    }
+
+    uint32_t n = tud_cdc_write(str, (len < available) ? len : available);
+    str += n;
+    len -= n;
+  }
+
+  if (newline) {
+    tud_cdc_write_flush();
+  }
+  xSemaphoreGiveRecursive(tx_mutex);
+}
+
+/** Flush pending output to the host. */
+static void cdc_flush(void) {
+  xSemaphoreTakeRecursive(tx_mutex, portMAX_DELAY);
+  tud_cdc_write_flush();
+  xSemaphoreGiveRecursive(tx_mutex);
+}
+
 /** Print string to CDC output. */
 static void print(const char *str) {
-  tud_cdc_write_str(str);
-  vTaskDelay(pdMS_TO_TICKS(1));  // needed to avoid garbled output
+  cdc_write(str, strlen(str));
 }
 
 /** tcli print callback function. */
@@ -36,13 +130,27 @@ static void tcli_print(void *arg, const char *str) {
 
 /** Print formatted string with variadic parameter list. */
 static void cdc_vprintf(const char *fmt, va_list ap) {
-  char buffer[128] = {0x00};
-  vsnprintf(buffer, 128, fmt, ap);
-  print(buffer);
+  static char buffer[CDC_PRINTF_LENGTH];
+
+  // static buffer is protected by the (recursive) output mutex
+  xSemaphoreTakeRecursive(tx_mutex, portMAX_DELAY);
+  int bytes = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  if (bytes > 0) {
+    cdc_write(buffer, (bytes < sizeof(buffer)) ? bytes : sizeof(buffer) - 1);
+  }
+  xSemaphoreGiveRecursive(tx_mutex);
 }
 
 void cdc_log(const char *str) {
+  // keep the log line and prompt redraw together
+  xSemaphoreTakeRecursive(tx_mutex, portMAX_DELAY);
   tclie_log(&tclie, str);
+  cdc_flush();
+  xSemaphoreGiveRecursive(tx_mutex);
+}
+
+void cdc_init(void) {
+  tx_mutex = xSemaphoreCreateRecursiveMutexStatic(&tx_mutex_static);
 }
 
 /** Print formatted string. */
@@ -68,14 +176,37 @@ static int show_version(void *arg) {
 }
 
 static int exec_debug(void *arg, int argc, const char *argv[]) {
-  if (argc == 2) {
-    if (strcmp(argv[1], "on") == 0) {
-      cec_log_enable();
-      return 0;
-    } else if (strcmp(argv[1], "off") == 0) {
-      cec_log_disable();
-      return 0;
+  uint32_t mask = CEC_LOG_MODULE_ALL;
+
+  if (argc == 1) {
+    uint32_t enabled = cec_log_enabled();
+    for (unsigned int m = 0; m < CEC_LOG_MODULE_MAX; m++) {
+      cdc_printfln("%-13s: %s", cec_log_module_name(m), (enabled & (1UL << m)) ? "on" : "off");
     }
+    return 0;
+  }
+
+  if (argc == 3) {
+    mask = 0;
+    for (unsigned int m = 0; m < CEC_LOG_MODULE_MAX; m++) {
+      if (strcmp(argv[1], cec_log_module_name(m)) == 0) {
+        mask = 1UL << m;
+      }
+    }
+    if (mask == 0) {
+      cdc_printfln("Unknown module '%s'", argv[1]);
+      return -1;
+    }
+  } else if (argc != 2) {
+    return -1;
+  }
+
+  if (strcmp(argv[argc - 1], "on") == 0) {
+    cec_log_enable(mask);
+    return 0;
+  } else if (strcmp(argv[argc - 1], "off") == 0) {
+    cec_log_disable(mask);
+    return 0;
   }
 
   return -1;
@@ -110,7 +241,11 @@ static void print_logical_address(uint8_t address) {
   cdc_printfln("%-17s: 0x%02x", "Logical address", address);
 }
 
-static int show_config(cec_config_t *config) {
+static void print_hid_interval(uint8_t interval) {
+  cdc_printfln("%-17s: %u ms", "HID interval", interval);
+}
+
+static int show_config(const cec_config_t *config) {
   // UBaseType_t uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
   // cdc_printfln("StackHighWaterMark = %lu", uxHighWaterMark);
 
@@ -139,6 +274,7 @@ static int show_config(cec_config_t *config) {
       break;
   }
   cdc_printfln("%-17s: %s", "Device type", type);
+  cdc_printfln("%-17s: %s", "Audio system", config->audio_system ? "on" : "off");
 
   const char *keymap = "unknown";
   switch (config->keymap_type) {
@@ -153,17 +289,165 @@ static int show_config(cec_config_t *config) {
       break;
   }
   cdc_printfln("%-17s: %s", "Keymap", keymap);
+  print_hid_interval(config->hid_interval_ms);
+
+  return 0;
+}
+
+static int show_macros(void) {
+  for (unsigned int n = 0; n < HID_MACRO_COUNT; n++) {
+    uint8_t code[HID_MACRO_LENGTH];
+    if (!cec_config_get_macro(n, code) || code[0] == HID_MACRO_OP_END) {
+      continue;
+    }
+
+    // trim trailing END padding
+    unsigned int len = HID_MACRO_LENGTH;
+    while (len > 0 && code[len - 1] == HID_MACRO_OP_END) {
+      len--;
+    }
+
+    char hex[(HID_MACRO_LENGTH * 2) + 1] = {0x00};
+    for (unsigned int i = 0; i < len; i++) {
+      snprintf(&hex[i * 2], 3, "%02x", code[i]);
+    }
+    cdc_printfln(" %u (0x%02x) : %s", n, HID_MACRO_KEY(n), hex);
+  }
 
   return 0;
 }
 
 static int show_stats_cec(void) {
-  cec_frame_stats_t stats = {0x0};
-  cec_frame_get_stats(&stats);
-  cdc_printfln("%-13s: %lu frames", "CEC rx", stats.rx_frames);
-  cdc_printfln("%-13s: %lu frames", "CEC tx", stats.tx_frames);
-  cdc_printfln("%-13s: %lu frames", "CEC rx abort", stats.rx_abort_frames);
-  cdc_printfln("%-13s: %lu frames", "CEC tx noack", stats.tx_noack_frames);
+  for (unsigned int i = 0; i < CEC_BUS_COUNT; i++) {
+    const cec_bus_t *bus = cec_frame_bus(i);
+    cec_frame_stats_t stats = {0x0};
+    cec_frame_get_stats(bus, &stats);
+    if (CEC_BUS_COUNT > 1) {
+      cdc_printfln("%-13s: %u (GPIO%u)", "CEC bus", i, bus->pin);
+    }
+    cdc_printfln("%-13s: %lu frames", "CEC rx", stats.rx_frames);
+    cdc_printfln("%-13s: %lu frames", "CEC tx", stats.tx_frames);
+    cdc_printfln("%-13s: %lu frames", "CEC rx abort", stats.rx_abort_frames);
+    cdc_printfln("%-13s: %lu frames", "CEC tx noack", stats.tx_noack_frames);
+    cdc_printfln("%-13s: %lu frames", "CEC flash", stats.flash_frames);
+    cdc_printfln("%-13s: %lu frames", "CEC flash err", stats.flash_errors);
+  }
+
+  usb_hid_stats_t keys = {0x0};
+  usb_hid_get_stats(&keys);
+  cdc_printfln("%-13s: %lu keys", "HID queued", keys.keys_queued);
+  cdc_printfln("%-13s: %lu keys", "HID coalesced", keys.keys_coalesced);
+  cdc_printfln("%-13s: %lu keys", "HID dropped", keys.keys_dropped);
+
+  return 0;
+}
+
+static int show_stats_log(void) {
+  cec_log_stats_t stats = {0x0};
+  cec_log_get_stats(&stats);
+  cdc_printfln("%-13s: %lu lines", "Log queued", stats.lines);
+  cdc_printfln("%-13s: %lu lines", "Log dropped", stats.dropped);
+  cdc_printfln("%-13s: %lu lines", "Log truncated", stats.truncated);
+  cdc_printfln("%-13s: %lu lines", "Log max depth", stats.high_water);
+  cdc_printfln("%-13s: %lu frames", "Log frm drop", stats.frames_dropped);
+
+  return 0;
+}
+
+static int show_stats_hid(void) {
+  usb_hid_stats_t stats = {0x0};
+  usb_hid_get_stats(&stats);
+  cdc_printfln("%-13s: %u ms", "HID interval", usb_descriptors_get_hid_interval());
+  cdc_printfln("%-13s: %lu", "HID reports", stats.reports);
+  cdc_printfln("%-13s: %lu/%lu us (min/max)", "HID latency", stats.latency_min_us,
+               stats.latency_max_us);
+  if (stats.poll_samples > 0) {
+    cdc_printfln("%-13s: %lu/%llu/%lu us (min/avg/max), %lu samples%s", "HID poll",
+                 stats.poll_min_us, stats.poll_total_us / stats.poll_samples, stats.poll_max_us,
+                 stats.poll_samples, usb_hid_measure_running() ? ", measuring" : "");
+  }
+
+  return 0;
+}
+
+static int show_stats_ddc(void) {
+  ddc_stats_t stats = {0x0};
+  ddc_get_stats(&stats);
+  cdc_printfln("%-13s: %lu kHz", "DDC speed",
+               (unsigned long)(ddc_get_frequency(stats.current) / 1000));
+  for (unsigned int i = 0; i < DDC_SPEED_COUNT; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "DDC %lu kHz", (unsigned long)(ddc_get_frequency(i) / 1000));
+    cdc_printfln("%-13s: %lu reads, %lu errors, %lu/%lu us (last/max)", name,
+                 (unsigned long)stats.speed[i].reads, (unsigned long)stats.speed[i].errors,
+                 (unsigned long)stats.speed[i].last_us, (unsigned long)stats.speed[i].max_us);
+  }
+#ifdef CEC_HPD_PIN
+  cdc_printfln("%-13s: %lu events", "DDC hot plug", (unsigned long)stats.hpd_events);
+#endif
+
+  return 0;
+}
+
+static int show_edid(bool hex) {
+  uint8_t edid[DDC_EDID_KEPT_BLOCKS * EDID_BLOCK_SIZE];
+  size_t len = ddc_get_edid(edid, sizeof(edid));
+
+  if (len == 0) {
+    cdc_printfln("No EDID read yet.");
+    return -1;
+  }
+
+  if (hex) {
+    for (size_t i = 0; i < len; i += 16) {
+      char line[8 + 16 * 3];
+      int pos = snprintf(line, sizeof(line), "%03x:", (unsigned int)i);
+      for (size_t j = 0; j < 16; j++) {
+        pos += snprintf(&line[pos], sizeof(line) - pos, " %02x", edid[i + j]);
+      }
+      cdc_printfln("%s", line);
+    }
+
+    return 0;
+  }
+
+  edid_identity_t identity;
+  if (!edid_decode_identity(edid, &identity)) {
+    cdc_printfln("Invalid EDID header.");
+    return -1;
+  }
+
+  cdc_printfln("%-17s: %s", "Manufacturer", identity.manufacturer);
+  cdc_printfln("%-17s: 0x%04x", "Product", identity.product);
+  cdc_printfln("%-17s: 0x%08lx", "Serial", (unsigned long)identity.serial);
+  if (identity.week == 0xff) {
+    cdc_printfln("%-17s: %u", "Model year", identity.year);
+  } else {
+    cdc_printfln("%-17s: week %u %u", "Manufactured", identity.week, identity.year);
+  }
+  cdc_printfln("%-17s: %u.%u", "EDID version", identity.version, identity.revision);
+  cdc_printfln("%-17s: %u", "Extensions", identity.extensions);
+  print_physical_address(ddc_get_physical_address());
+
+  edid_info_t info;
+  if (ddc_get_info(&info)) {
+    cdc_printfln("%-17s: %s", "Name", info.name);
+    cdc_printfln("%-17s: %s", "Supports AI", info.supports_ai ? "yes" : "no");
+    cdc_printfln("%-17s: %u MHz", "Max TMDS clock", info.max_tmds_mhz);
+    if (!edid_has_audio(&info)) {
+      cdc_printfln("%-17s: none", "Audio");
+    } else {
+      cdc_printfln("%-17s: %s%s%s%s%s%s%s, %u channels", "Audio",
+                   info.basic_audio ? "basic " : "",
+                   (info.audio_formats & EDID_AUDIO_LPCM) ? "LPCM " : "",
+                   (info.audio_formats & EDID_AUDIO_AC3) ? "AC-3 " : "",
+                   (info.audio_formats & EDID_AUDIO_EAC3) ? "E-AC-3 " : "",
+                   (info.audio_formats & EDID_AUDIO_DTS) ? "DTS " : "",
+                   (info.audio_formats & EDID_AUDIO_DTS_HD) ? "DTS-HD " : "",
+                   (info.audio_formats & EDID_AUDIO_TRUEHD) ? "TrueHD " : "",
+                   info.audio_channels);
+    }
+  }
 
   return 0;
 }
@@ -209,24 +493,82 @@ static int show_stats_tasks(void) {
   return 0;
 }
 
+static int show_crashlog(void) {
+  const crashlog_t *log = crashlog_get();
+  if (log == NULL) {
+    cdc_printfln("No crash log retained.");
+    return 0;
+  }
+
+  cdc_printfln("%-13s: %s", "Reason", crashlog_reason_name(log->reason));
+  cdc_printfln("%-13s: %lu ms", "Uptime", log->uptime_ms);
+  if (log->task[0] != '\0') {
+    cdc_printfln("%-13s: %.*s", "Task", (int)sizeof(log->task), log->task);
+  }
+  if (log->reason == CRASHLOG_REASON_HARDFAULT) {
+    cdc_printfln("%-13s: 0x%08lx", "PC", log->regs.pc);
+    cdc_printfln("%-13s: 0x%08lx", "LR", log->regs.lr);
+    cdc_printfln("%-13s: 0x%08lx", "xPSR", log->regs.xpsr);
+    cdc_printfln("%-13s: 0x%08lx 0x%08lx 0x%08lx 0x%08lx", "R0-R3", log->regs.r0, log->regs.r1,
+                 log->regs.r2, log->regs.r3);
+    cdc_printfln("%-13s: 0x%08lx", "R12", log->regs.r12);
+  }
+
+  // oldest event first
+  uint32_t count = log->head < CRASHLOG_EVENT_COUNT ? log->head : CRASHLOG_EVENT_COUNT;
+  for (uint32_t i = log->head - count; i != log->head; i++) {
+    const crashlog_event_t *event = &log->events[i % CRASHLOG_EVENT_COUNT];
+    if (event->flags & CRASHLOG_EVENT_INVALID) {
+      cdc_printfln("[%10s] damaged", "?");
+      continue;
+    }
+    const char *dir = (event->flags & CRASHLOG_EVENT_RX) ? "rx" : "tx";
+    const char *ack = (event->flags & CRASHLOG_EVENT_ACK) ? "ack" : "noack";
+    if (event->flags & CRASHLOG_EVENT_ABORT) {
+      ack = "abort";
+    }
+    cdc_printfln("[%10lu] %s %-5s %2u: %02x %02x", event->timestamp_ms, dir, ack, event->len,
+                 event->data[0], event->data[1]);
+  }
+
+  return 0;
+}
+
 static int exec_show(void *arg, int argc, const char **argv) {
   if (argc == 2) {
     if (strcmp(argv[1], "config") == 0) {
       return show_config(&config);
     } else if (strcmp(argv[1], "keymap") == 0) {
       for (uint8_t n = 0; n < UINT8_MAX; n++) {
-        if (config.keymap[n].name != NULL) {
-          cdc_printfln(" 0x%02x : %02u : %s", n, config.keymap[n].key, config.keymap[n].name);
+        if (config.keymap[n] != 0x00) {
+          const char *name = cec_user_control_name(n);
+          cdc_printfln(" 0x%02x : %02u : %s", n, config.keymap[n], name != NULL ? name : "?");
         }
       }
+    } else if (strcmp(argv[1], "macro") == 0) {
+      return show_macros();
     } else if (strcmp(argv[1], "cec") == 0) {
-      print_physical_address(cec_get_physical_address());
-      print_logical_address(cec_get_logical_address());
+      for (unsigned int i = 0; i < CEC_BUS_COUNT; i++) {
+        if (CEC_BUS_COUNT > 1) {
+          cdc_printfln("%-17s: %u (GPIO%u)", "CEC bus", i, cec_frame_bus(i)->pin);
+        }
+        print_physical_address(cec_get_physical_address(i));
+        print_logical_address(cec_get_logical_address(i));
+        cdc_printfln("%-17s: 0x%04x", "Address mask", cec_get_logical_addresses(i));
+      }
     } else if (strcmp(argv[1], "version") == 0) {
       return show_version(arg);
+    } else if (strcmp(argv[1], "crashlog") == 0) {
+      return show_crashlog();
+    } else if (strcmp(argv[1], "edid") == 0) {
+      return show_edid(false);
     } else if (strcmp(argv[1], "nvs") == 0) {
+      // used in place from flash, unless it needs migrating
+      const cec_config_t *stored = nvs_get_config();
       cec_config_t nvs_config;
-      if (nvs_read_config(&nvs_config)) {
+      if (stored != NULL) {
+        return show_config(stored);
+      } else if (nvs_read_config(&nvs_config)) {
         return show_config(&nvs_config);
       } else {
         cdc_printfln("Failed to read configuration from NVS.");
@@ -234,9 +576,17 @@ static int exec_show(void *arg, int argc, const char **argv) {
       }
     }
   } else if (argc == 3) {
-    if (strcmp(argv[1], "stats") == 0) {
+    if (strcmp(argv[1], "edid") == 0 && strcmp(argv[2], "hex") == 0) {
+      return show_edid(true);
+    } else if (strcmp(argv[1], "stats") == 0) {
       if (strcmp(argv[2], "cec") == 0) {
         return show_stats_cec();
+      } else if (strcmp(argv[2], "ddc") == 0) {
+        return show_stats_ddc();
+      } else if (strcmp(argv[2], "hid") == 0) {
+        return show_stats_hid();
+      } else if (strcmp(argv[2], "log") == 0) {
+        return show_stats_log();
       } else if (strcmp(argv[2], "cpu") == 0) {
         return show_stats_cpu();
       } else if (strcmp(argv[2], "tasks") == 0) {
@@ -251,8 +601,31 @@ static int exec_show(void *arg, int argc, const char **argv) {
 static int exec_query(void *arg, int argc, const char **argv) {
   if (argc == 2) {
     if (strcmp(argv[1], "edid") == 0) {
+      ddc_result_t result = ddc_refresh_wait(pdMS_TO_TICKS(1000));
+      if (result == DDC_RESULT_TIMEOUT) {
+        cdc_printfln("Timed out reading EDID");
+        ddc_cancel();
+        return -1;
+      } else if (result == DDC_RESULT_FAILED) {
+        cdc_printfln("Failed to read EDID");
+        return -1;
+      }
       print_physical_address(ddc_get_physical_address());
-      return -1;
+      return 0;
+    } else if (strcmp(argv[1], "hid") == 0) {
+      if (!usb_hid_measure_start()) {
+        cdc_printfln("Failed to start HID measurement");
+        return -1;
+      }
+      // a full measurement takes over a minute at the slowest interval
+      for (unsigned int i = 0; i < (CDC_QUERY_HID_WAIT_MS / 100) && usb_hid_measure_running();
+           i++) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+      }
+      if (usb_hid_measure_running()) {
+        cdc_printfln("HID measurement continues, see 'show stats hid'");
+      }
+      return show_stats_hid();
     }
   }
 
@@ -263,16 +636,72 @@ static int exec_save(void *arg, int argc, const char **argv) {
   // UBaseType_t uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
   // cdc_printfln("StackHighWaterMark = %lu", uxHighWaterMark);
 
-  bool r = nvs_save_config(&config);
+  bool r = cec_config_save_macros() && nvs_save_config(&config);
 
   // cdc_printfln("r = %u", r);
 
   return r ? 0 : -1;
 }
 
-static int exec_set(void *arg, int argc, const char **argv) {
+/**
+ * Set a macro from a string of hex encoded bytecode.
+ */
+static int set_macro(const char *index, const char *hex) {
+  unsigned int n = atoi(index);
+  size_t len = strlen(hex);
+
+  if (n >= HID_MACRO_COUNT) {
+    cdc_printfln("Macro index out of range (0-%u)", HID_MACRO_COUNT - 1);
+    return -1;
+  }
+
+  if ((len % 2) != 0 || (len / 2) > HID_MACRO_LENGTH) {
+    cdc_printfln("Macro must be up to %u hex encoded bytes", HID_MACRO_LENGTH);
+    return -1;
+  }
+
+  uint8_t code[HID_MACRO_LENGTH] = {HID_MACRO_OP_END};
+  for (size_t i = 0; i < (len / 2); i++) {
+    if (sscanf(&hex[i * 2], "%2hhx", &code[i]) != 1) {
+      cdc_printfln("Error parsing macro");
+      return -1;
+    }
+  }
+
+  cec_config_set_macro(n, code);
+
+  return 0;
+}
+
+/**
+ * Map a single CEC user control code to a HID key or macro.
+ */
+static int set_key(const char *code, const char *value) {
+  uint8_t c, key;
+
+  if (sscanf(code, "%hhx", &c) != 1 || c >= UINT8_MAX) {
+    cdc_printfln("Error parsing user control code");
+    return -1;
+  }
+
+  if (sscanf(value, "%hhx", &key) != 1) {
+    cdc_printfln("Error parsing HID key");
+    return -1;
+  }
+
+  config.keymap_type = CEC_CONFIG_KEYMAP_CUSTOM;
+  config.keymap[c] = key;
+
+  return 0;
+}
+
+static int set_config(int argc, const char **argv) {
   if (argc == 4) {
-    if (strcmp(argv[1], "config") == 0) {
+    if (strcmp(argv[1], "key") == 0) {
+      return set_key(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "macro") == 0) {
+      return set_macro(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "config") == 0) {
       if (strcmp(argv[2], "edid_delay_ms") == 0) {
         config.edid_delay_ms = atoi(argv[3]);
         print_edid_delay(config.edid_delay_ms);
@@ -294,6 +723,16 @@ static int exec_set(void *arg, int argc, const char **argv) {
           cdc_printfln("Error parsing logical address");
           return -1;
         }
+      } else if (strcmp(argv[2], "hid_interval_ms") == 0) {
+        int interval = atoi(argv[3]);
+        if (interval < 1 || interval > UINT8_MAX) {
+          cdc_printfln("HID interval must be 1 to 255 ms");
+          return -1;
+        }
+        config.hid_interval_ms = interval;
+        print_hid_interval(config.hid_interval_ms);
+        cdc_printfln("Save and reboot to apply");
+        return 0;
       } else if (strcmp(argv[2], "device_type") == 0) {
         if (strcmp(argv[3], "playback") == 0) {
           config.device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
@@ -305,6 +744,17 @@ static int exec_set(void *arg, int argc, const char **argv) {
           cdc_printfln("Unknown device type \'%s\'", argv[3]);
           return -1;
         }
+      } else if (strcmp(argv[2], "audio_system") == 0) {
+        if (strcmp(argv[3], "on") == 0) {
+          config.audio_system = true;
+          return 0;
+        } else if (strcmp(argv[3], "off") == 0) {
+          config.audio_system = false;
+          return 0;
+        } else {
+          cdc_printfln("Audio system must be on or off");
+          return -1;
+        }
       }
     }
   } else if (argc == 3) {
@@ -327,27 +777,59 @@ static int exec_set(void *arg, int argc, const char **argv) {
   return -1;
 }
 
+static int exec_set(void *arg, int argc, const char **argv) {
+  int ret = set_config(argc, argv);
+
+  if (ret == 0) {
+    // publish, cec_task picks it up on the next frame
+    cec_config_set(&config);
+    if (strcmp(argv[1], "macro") == 0) {
+      // a running macro may be the one just replaced
+      usb_hid_macro_cancel();
+    }
+  }
+
+  return ret;
+}
+
 static const tclie_cmd_t cmds[] = {
-    {"debug", exec_debug, "Control debug output.", "debug {on|off}"},
-    {"query", exec_query, "Query information.", "query {edid}"},
+    {"debug", exec_debug, "Control debug output.",
+     "debug [[phy|protocol|ddc|nvs|usb] {on|off}]"},
+    {"query", exec_query, "Query information.", "query {edid|hid}"},
     {"save", exec_save, "Save configuration.", "save"},
     {"set", exec_set, "Set configuration parameters.",
-     "set {(config (edid_delay_ms|logical_address|physical_address <value>)|(device_type "
-     "{playback|recording}))|(keymap <value>)}"},
+     "set {(config (edid_delay_ms|hid_interval_ms|logical_address|physical_address <value>)|"
+     "(device_type {playback|recording})|(audio_system {on|off}))|(keymap <value>)|"
+     "(key <code> <value>)|(macro <index> <value>)}"},
     {"show", exec_show, "Show information.",
-     "show {cec|config|keymap|nvs|(stats {cec|cpu|tasks})|version}"},
+     "show {cec|config|crashlog|(edid [hex])|keymap|macro|nvs|(stats {cec|cpu|ddc|hid|log|tasks})|"
+     "version}"},
     {"reboot", exec_reboot, "Reboot system.", "reboot [bootsel]"},
 };
 
+static void cdc_notify(uint32_t bits) {
+  if (xCDCTask != NULL) {
+    xTaskNotify(xCDCTask, bits, eSetBits);
+  }
+}
+
 void cdc_task(void *params) {
   (void)params;
 
-  nvs_load_config(&config);
+  xCDCTask = xTaskGetCurrentTaskHandle();
+
+  // working copy of the live configuration, only this task changes it
+  cec_config_get(&config);
 
   tclie_init(&tclie, tcli_print, NULL);
   tclie_reg_cmds(&tclie, cmds, ARRAY_SIZE(cmds));
 
   while (1) {
+    uint32_t bits = 0;
+
+    // sleep until woken by a TinyUSB callback
+    xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
     // connected() check for DTR bit
     // Most but not all terminal client set this when making connection
     if (tud_cdc_connected()) {
@@ -357,14 +839,31 @@ void cdc_task(void *params) {
         tclie_input_char(&tclie, c);
       }
 
-      tud_cdc_write_flush();
-      vTaskDelay(pdMS_TO_TICKS(1));
-    } else {
-      vTaskDelay(pdMS_TO_TICKS(50));
+      // idle, push out any partial line (eg. prompt, echo)
+      cdc_flush();
     }
   }
 }
 
+// Invoked when CDC interface received data from host
+void tud_cdc_rx_cb(uint8_t itf) {
+  (void)itf;
+
+  cdc_notify(CDC_NOTIFY_RX);
+}
+
+// Invoked when a CDC transfer to the host has completed
+void tud_cdc_tx_complete_cb(uint8_t itf) {
+  (void)itf;
+
+  TaskHandle_t waiter = tx_waiter;
+  if (waiter != NULL) {
+    xTaskNotifyGiveIndexed(waiter, CDC_NOTIFY_INDEX_TX);
+  }
+
+  cdc_notify(CDC_NOTIFY_TX);
+}
+
 void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
   (void)itf;
   (void)rts;
@@ -376,4 +875,6 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
     // Terminal disconnected
     tud_cdc_write_str("Disconnected"_CDC_BR);
   }
+
+  cdc_notify(CDC_NOTIFY_LINE);
 }
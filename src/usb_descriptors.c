@@ -51,6 +51,11 @@
 #define USBD_CDC_EP_IN (0x82)
 #define USBD_CDC_IN_OUT_MAX_SIZE (64)
 
+/**
+ * HID descriptor constants.
+ */
+#define USBD_HID_INTERVAL_MS (5)
+
 //--------------------------------------------------------------------+
 // Device Descriptors
 //--------------------------------------------------------------------+
@@ -102,6 +107,9 @@ enum { ITF_NUM_HID, ITF_NUM_CDC, ITF_NUM_CDC_DATA, ITF_NUM_TOTAL };
 
 #define EPNUM_HID 0x84
 
+/** Offset of the HID endpoint bInterval, the last byte of the HID descriptor. */
+#define HID_INTERVAL_OFFSET (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN - 1)
+
 uint8_t const desc_configuration[] = {
     // Config number, interface count, string index, total length, attribute, power in mA
     TUD_CONFIG_DESCRIPTOR(1,
@@ -119,7 +127,7 @@ uint8_t const desc_configuration[] = {
                        sizeof(desc_hid_report),
                        EPNUM_HID,
                        CFG_TUD_HID_EP_BUFSIZE,
-                       5),
+                       USBD_HID_INTERVAL_MS),
 
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC,
                        USBD_STR_CDC,
@@ -129,6 +137,28 @@ uint8_t const desc_configuration[] = {
                        USBD_CDC_EP_IN,
                        USBD_CDC_IN_OUT_MAX_SIZE)};
 
+/** HID polling interval from configuration, patched into a copy of the descriptor. */
+static uint8_t hid_interval_ms = USBD_HID_INTERVAL_MS;
+
+/** Configuration descriptor as sent, desc_configuration with the HID interval patched. */
+static uint8_t desc_configuration_patched[CONFIG_TOTAL_LEN];
+
+void usb_descriptors_set_hid_interval(uint8_t interval_ms) {
+  // full-speed interrupt endpoints support 1 to 255 frames
+  hid_interval_ms = (interval_ms == 0) ? 1 : interval_ms;
+}
+
+uint8_t usb_descriptors_get_hid_interval(void) {
+  return hid_interval_ms;
+}
+
+static uint8_t const *patch_configuration(void) {
+  memcpy(desc_configuration_patched, desc_configuration, CONFIG_TOTAL_LEN);
+  desc_configuration_patched[HID_INTERVAL_OFFSET] = hid_interval_ms;
+
+  return desc_configuration_patched;
+}
+
 #if TUD_OPT_HIGH_SPEED
 // Per USB specs: high speed capable device must report device_qualifier and
 // other_speed_configuration
@@ -168,7 +198,7 @@ uint8_t const *tud_descriptor_other_speed_configuration_cb(uint8_t index) {
   (void)index;  // for multiple configurations
 
   // other speed config is basically configuration with type = OHER_SPEED_CONFIG
-  memcpy(desc_other_speed_config, desc_configuration, CONFIG_TOTAL_LEN);
+  memcpy(desc_other_speed_config, patch_configuration(), CONFIG_TOTAL_LEN);
   desc_other_speed_config[1] = TUSB_DESC_OTHER_SPEED_CONFIG;
 
   // this example use the same configuration for both high and full speed mode
@@ -182,7 +212,7 @@ uint8_t const *tud_descriptor_other_speed_configuration_cb(uint8_t index) {
 // Descriptor contents must exist long enough for transfer to complete
 uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
   (void)index;  // for multiple configurations
-  return desc_configuration;
+  return patch_configuration();
 }
 
 //--------------------------------------------------------------------+
@@ -36,6 +36,11 @@
 #include "pico/stdlib.h"
 #include "tusb.h"
 
+#include "pico-cec/config.h"
+
+#include "cec-config.h"
+#include "cec-log.h"
+#include "hid-macro.h"
 #include "usb_descriptors.h"
 #include "usb_hid.h"
 
@@ -63,67 +68,342 @@ void usb_task(void *param) {
 //--------------------------------------------------------------------+
 
 // Invoked when device is mounted
-void tud_mount_cb(void) {}
+void tud_mount_cb(void) {
+  CEC_LOG_INFO(CEC_LOG_USB, "Mounted");
+}
 
 // Invoked when device is unmounted
-void tud_umount_cb(void) {}
+void tud_umount_cb(void) {
+  CEC_LOG_INFO(CEC_LOG_USB, "Unmounted");
+}
 
 // Invoked when usb bus is suspended
 // remote_wakeup_en : if host allow us  to perform remote wakeup
 // Within 7ms, device must draw an average of current less than 2.5 mA from bus
 void tud_suspend_cb(bool remote_wakeup_en) {
-  (void)remote_wakeup_en;
+  CEC_LOG_INFO(CEC_LOG_USB, "Suspended, remote wakeup %s", remote_wakeup_en ? "on" : "off");
 }
 
 // Invoked when usb bus is resumed
-void tud_resume_cb(void) {}
+void tud_resume_cb(void) {
+  CEC_LOG_INFO(CEC_LOG_USB, "Resumed");
+}
 
 //--------------------------------------------------------------------+
 // USB HID
 //--------------------------------------------------------------------+
 
+/** Upper bound on waiting for a report to complete, guards against bus state changes. */
+#define HID_READY_TIMEOUT_MS (100)
+
+/** Number of host polls sampled in measurement mode. */
+#define HID_MEASURE_SAMPLES (250)
+
+/** Queued to start measuring the host poll cadence, also from the reserved range. */
+#define HID_KEY_MEASURE (0xfe)
+
+/** Queue entries which are requests to the HID task rather than keys. */
+#define HID_KEY_IS_CONTROL(k) ((k) == HID_MACRO_KEY_CANCEL || (k) == HID_KEY_MEASURE)
+
+static TaskHandle_t xHIDTask;
+static QueueHandle_t hid_q;
+
+/** Last entry sent to the HID queue, still its tail while the queue is not empty. */
+static uint8_t last_key = HID_KEY_NONE;
+
+/** A macro is running, see usb_hid_macro_cancel(). */
+static volatile bool macro_running;
+
+/** Time the outstanding report was submitted. */
+static volatile uint64_t report_submit_us;
+
+/** Remaining host polls to sample, non-zero in measurement mode. */
+static volatile uint32_t measure_remaining;
+static uint64_t measure_last_us;
+
+static usb_hid_stats_t hid_stats;
+
+/**
+ * Wait for the HID endpoint to be ready for a new report.
+ *
+ * Woken by tud_hid_report_complete_cb(), returns false if the host goes away.
+ */
+static bool wait_hid_ready(void) {
+  while (!tud_hid_ready()) {
+    if (!tud_mounted() || tud_suspended()) {
+      return false;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HID_READY_TIMEOUT_MS));
+  }
+
+  return true;
+}
+
+static void keyboard_report(uint8_t modifier, const uint8_t *keycode) {
+  report_submit_us = time_us_64();
+  if (tud_hid_keyboard_report(REPORT_ID_KEYBOARD, modifier, keycode)) {
+    hid_stats.reports++;
+  }
+}
+
 static void send_hid_report(uint8_t key) {
-  // skip if hid is not ready yet
-  if (!tud_hid_ready())
+  if (!wait_hid_ready()) {
     return;
+  }
 
   uint8_t keycode[6] = {0};
   keycode[0] = key;
 
   if (key == HID_KEY_NONE) {
-    tud_hid_keyboard_report(REPORT_ID_KEYBOARD, key, NULL);
+    keyboard_report(0, NULL);
   } else {
-    tud_hid_keyboard_report(REPORT_ID_KEYBOARD, 0, keycode);
+    keyboard_report(0, keycode);
   }
 }
 
+/**
+ * Execute one step of a running macro.
+ *
+ * The delay before the next step is returned in delay. Returns false when the
+ * macro has completed or was abandoned.
+ */
+static bool run_macro(hid_macro_t *macro, TickType_t *delay) {
+  bool report = false;
+  int32_t delay_ms = hid_macro_step(macro, &report);
+
+  if (report) {
+    // wait for the previous report to be collected by the host
+    if (!wait_hid_ready()) {
+      return false;
+    }
+    keyboard_report(macro->modifier, macro->keycode);
+  }
+
+  *delay = delay_ms > 0 ? pdMS_TO_TICKS(delay_ms) : 0;
+
+  return (delay_ms >= 0);
+}
+
 void hid_task(void *param) {
   QueueHandle_t *q = (QueueHandle_t *)param;
+  hid_macro_t macro = {0};
+  bool running = false;
+  TickType_t delay = 0;
+  TickType_t step = 0;
+
+  xHIDTask = xTaskGetCurrentTaskHandle();
+  hid_q = *q;
 
   while (1) {
-    // Poll every 100ms
+    macro_running = running;
+
+    // a running macro waits for its next step on the queue, so a new key
+    // aborts it
+    TickType_t wait = portMAX_DELAY;
+    if (running) {
+      TickType_t elapsed = xTaskGetTickCount() - step;
+      wait = elapsed < delay ? delay - elapsed : 0;
+    }
+
+    // Block until a key arrives
     uint8_t key = HID_KEY_NONE;
-    BaseType_t r = xQueueReceive(*q, &key, pdMS_TO_TICKS(100));
-    if (r == pdTRUE) {
+    BaseType_t r = xQueueReceive(*q, &key, wait);
+    if (r != pdTRUE) {
+      if (running) {
+        running = run_macro(&macro, &delay);
+        step = xTaskGetTickCount();
+      }
+      continue;
+    }
+
+    if (running) {
+      if (key == HID_KEY_NONE) {
+        // release of the key which started it, the macro releases its own keys
+        continue;
+      }
+
+      // release whatever the macro held down
+      running = false;
+      send_hid_report(HID_KEY_NONE);
+    }
+
+    if (key == HID_KEY_MEASURE) {
+      // an empty report starts the chain, continued by tud_hid_report_complete_cb()
+      send_hid_report(HID_KEY_NONE);
+    } else if (key != HID_MACRO_KEY_CANCEL) {
       // Remote wakeup
       if (tud_suspended()) {
         // Wake up host if we are in suspend mode
         // and REMOTE_WAKEUP feature is enabled by host
         tud_remote_wakeup();
+      } else if (HID_MACRO_IS_KEY(key)) {
+        uint8_t code[HID_MACRO_LENGTH];
+        running = cec_config_get_macro(key - HID_MACRO_KEY_BASE, code) &&
+                  hid_macro_start(&macro, code);
+        delay = 0;
+        step = xTaskGetTickCount();
       } else {
-        // Send the 1st of report chain, the rest will be sent by tud_hid_report_complete_cb()
         send_hid_report(key);
       }
     }
   }
 }
 
+void usb_hid_get_stats(usb_hid_stats_t *stats) {
+  *stats = hid_stats;
+}
+
+/**
+ * Drop the oldest key from the full HID queue, the control entries ahead of
+ * it are kept in order. Returns false if only control entries are queued.
+ *
+ * Called with the scheduler suspended.
+ */
+static bool drop_oldest_key(void) {
+  uint8_t keep[CEC_QUEUE_LENGTH];
+  unsigned int count = 0;
+  bool dropped = false;
+  uint8_t key;
+
+  while (count < CEC_QUEUE_LENGTH && xQueueReceive(hid_q, &key, 0) == pdTRUE) {
+    if (!dropped && !HID_KEY_IS_CONTROL(key)) {
+      dropped = true;
+    } else {
+      keep[count++] = key;
+    }
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    xQueueSend(hid_q, &keep[i], 0);
+  }
+
+  return dropped;
+}
+
+/**
+ * Send an entry to the HID queue without blocking.
+ *
+ * Every producer goes through here, so last_key is the real tail. A key
+ * identical to the one still pending at the tail is merged (eg. repeated
+ * presses while a button is held). If the queue is full the oldest key is
+ * dropped, the newest key always reflects the remote state. Control entries
+ * are never merged or dropped.
+ */
+static bool queue_send(uint8_t key) {
+  if (hid_q == NULL) {
+    return false;
+  }
+
+  bool control = HID_KEY_IS_CONTROL(key);
+
+  // the CEC tasks and the CLI all send to the same queue, keep the tail check atomic
+  vTaskSuspendAll();
+
+  if (!control && uxQueueMessagesWaiting(hid_q) > 0 && key == last_key) {
+    hid_stats.keys_coalesced++;
+    xTaskResumeAll();
+    return true;
+  }
+
+  bool sent = (xQueueSend(hid_q, &key, 0) == pdTRUE);
+  if (!sent && drop_oldest_key()) {
+    hid_stats.keys_dropped++;
+    sent = (xQueueSend(hid_q, &key, 0) == pdTRUE);
+  }
+
+  if (sent) {
+    last_key = key;
+  }
+  if (!control) {
+    if (sent) {
+      hid_stats.keys_queued++;
+    } else {
+      hid_stats.keys_dropped++;
+    }
+  }
+
+  xTaskResumeAll();
+
+  return sent;
+}
+
+void usb_hid_send_key(uint8_t key) {
+  queue_send(key);
+}
+
+bool usb_hid_measure_start(void) {
+  if (hid_q == NULL || !tud_mounted() || measure_remaining > 0 || macro_running) {
+    return false;
+  }
+
+  hid_stats.poll_samples = 0;
+  hid_stats.poll_min_us = UINT32_MAX;
+  hid_stats.poll_max_us = 0;
+  hid_stats.poll_total_us = 0;
+  measure_last_us = 0;
+  measure_remaining = HID_MEASURE_SAMPLES + 1;
+
+  if (!queue_send(HID_KEY_MEASURE)) {
+    measure_remaining = 0;
+    return false;
+  }
+
+  return true;
+}
+
+bool usb_hid_measure_running(void) {
+  return (measure_remaining > 0);
+}
+
+void usb_hid_macro_cancel(void) {
+  if (hid_q == NULL || !macro_running) {
+    return;
+  }
+
+  queue_send(HID_MACRO_KEY_CANCEL);
+}
+
 // Invoked when sent REPORT successfully to host
 // Application can use this to send the next report
 // Note: For composite reports, report[0] is report ID
 void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len) {
   (void)instance;
+  (void)report;
   (void)len;
+
+  uint64_t now = time_us_64();
+  uint32_t latency = now - report_submit_us;
+
+  if (hid_stats.latency_min_us == 0 || latency < hid_stats.latency_min_us) {
+    hid_stats.latency_min_us = latency;
+  }
+  if (latency > hid_stats.latency_max_us) {
+    hid_stats.latency_max_us = latency;
+  }
+
+  if (measure_remaining > 0) {
+    // back-to-back empty reports complete once per host poll
+    if (measure_last_us != 0) {
+      uint32_t interval = now - measure_last_us;
+      hid_stats.poll_samples++;
+      hid_stats.poll_total_us += interval;
+      if (interval < hid_stats.poll_min_us) {
+        hid_stats.poll_min_us = interval;
+      }
+      if (interval > hid_stats.poll_max_us) {
+        hid_stats.poll_max_us = interval;
+      }
+    }
+    measure_last_us = now;
+
+    if (--measure_remaining > 0) {
+      report_submit_us = now;
+      tud_hid_keyboard_report(REPORT_ID_KEYBOARD, 0, NULL);
+    }
+  }
+
+  if (xHIDTask != NULL) {
+    xTaskNotifyGive(xHIDTask);
+  }
 }
 
 // Invoked when received GET_REPORT control request
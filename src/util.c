@@ -8,3 +8,24 @@
 uint64_t util_uptime_ms(void) {
   return (time_us_64() / 1000);
 }
+
+/**
+ * Binary search a sorted name index.
+ */
+const char *util_name_find(const util_name_t *index, size_t count, const char *pool, uint8_t key) {
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index[mid].key == key) {
+      return &pool[index[mid].offset];
+    } else if (index[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return NULL;
+}
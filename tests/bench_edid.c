@@ -0,0 +1,72 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "edid.h"
+
+/**
+ * EDID parser benchmark.
+ *
+ * Each file is streamed through edid_parse_block() one block at a time, the
+ * same way the DDC task reads them from the sink, and the mean time per EDID
+ * printed. Build with SANITIZE off and optimised for representative numbers.
+ */
+
+/** Parses of each file, enough for the clock resolution not to matter. */
+#define BENCH_ITERATIONS (100000)
+
+/** Largest EDID, block 0 and 255 extensions. */
+#define BENCH_MAX_SIZE (256 * EDID_BLOCK_SIZE)
+
+static uint8_t edid[BENCH_MAX_SIZE];
+
+/** Defeats dead code elimination of the parse. */
+static volatile uint16_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void parse(const uint8_t *data, size_t size) {
+  edid_parser_t parser;
+  edid_parser_init(&parser);
+
+  for (unsigned int i = 0; ((size_t)i + 1) * EDID_BLOCK_SIZE <= size; i++) {
+    if (edid_parse_block(&parser, i, &data[(size_t)i * EDID_BLOCK_SIZE]) != EDID_PARSE_MORE) {
+      break;
+    }
+  }
+
+  sink = parser.info.physical_address;
+}
+
+int main(int argc, char *argv[]) {
+  int failed = 0;
+
+  for (int i = 1; i < argc; i++) {
+    FILE *file = fopen(argv[i], "rb");
+    if (file == NULL) {
+      fprintf(stderr, "%s: cannot open\n", argv[i]);
+      failed = 1;
+      continue;
+    }
+    size_t size = fread(edid, 1, sizeof(edid), file);
+    fclose(file);
+
+    uint64_t start = now_ns();
+    for (unsigned int n = 0; n < BENCH_ITERATIONS; n++) {
+      parse(edid, size);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    const char *name = strrchr(argv[i], '/');
+    printf("%-32s %8.1f ns/EDID\n", name ? name + 1 : argv[i], (double)elapsed / BENCH_ITERATIONS);
+  }
+
+  return failed;
+}
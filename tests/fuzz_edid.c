@@ -0,0 +1,54 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edid.h"
+
+/**
+ * EDID parser fuzz target.
+ *
+ * The input is split into EDID_BLOCK_SIZE blocks and fed to the streaming
+ * parser one block at a time, the same way the DDC task reads them from the
+ * sink. A trailing partial block is dropped, as the DDC task never hands one
+ * over. Each block is copied to its own allocation so reads past the end of
+ * a block are caught by the address sanitizer.
+ */
+
+static void check(const edid_info_t *info) {
+  if (memchr(info->manufacturer, '\0', sizeof(info->manufacturer)) == NULL ||
+      memchr(info->name, '\0', sizeof(info->name)) == NULL) {
+    abort();
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  edid_parser_t parser;
+  edid_parser_init(&parser);
+
+  uint8_t *block = malloc(EDID_BLOCK_SIZE);
+  if (block == NULL) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; ((size_t)i + 1) * EDID_BLOCK_SIZE <= size; i++) {
+    memcpy(block, &data[(size_t)i * EDID_BLOCK_SIZE], EDID_BLOCK_SIZE);
+
+    edid_checksum_ok(block);
+    if (i == 0) {
+      edid_identity_t identity;
+      edid_decode_identity(block, &identity);
+    }
+
+    edid_parse_t result = edid_parse_block(&parser, i, block);
+    check(&parser.info);
+    edid_has_audio(&parser.info);
+    if (result != EDID_PARSE_MORE) {
+      break;
+    }
+  }
+
+  free(block);
+
+  return 0;
+}
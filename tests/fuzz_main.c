@@ -0,0 +1,58 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Replays files through a fuzz target, for compilers without libFuzzer.
+ */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char *argv[]) {
+  int failed = 0;
+
+  for (int i = 1; i < argc; i++) {
+    FILE *file = fopen(argv[i], "rb");
+    if (file == NULL) {
+      fprintf(stderr, "%s: cannot open\n", argv[i]);
+      failed = 1;
+      continue;
+    }
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    for (;;) {
+      if (size == capacity) {
+        capacity = capacity ? capacity * 2 : 4096;
+        uint8_t *grown = realloc(data, capacity);
+        if (grown == NULL) {
+          abort();
+        }
+        data = grown;
+      }
+      size_t n = fread(&data[size], 1, capacity - size, file);
+      if (n == 0) {
+        break;
+      }
+      size += n;
+    }
+    fclose(file);
+
+    // exact size allocation, so overreads of the input are caught too
+    uint8_t *input = malloc(size ? size : 1);
+    if (input == NULL) {
+      abort();
+    }
+    memcpy(input, data, size);
+    free(data);
+
+    LLVMFuzzerTestOneInput(input, size);
+    free(input);
+    printf("%s: %zu bytes\n", argv[i], size);
+  }
+
+  return failed;
+}
@@ -0,0 +1,26 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Host stand in for the FreeRTOS types used by the modules under test.
+ */
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+
+typedef struct {
+  int taken;
+} StaticSemaphore_t;
+
+#define pdTRUE (1)
+#define pdFALSE (0)
+#define portMAX_DELAY (0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
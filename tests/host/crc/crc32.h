@@ -0,0 +1,8 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+uint32_t crc32(const unsigned char *buf, unsigned int len);
+
+#endif
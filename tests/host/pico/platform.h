@@ -0,0 +1,7 @@
+#ifndef PICO_PLATFORM_H
+#define PICO_PLATFORM_H
+
+/** No flash on the host, the tables stay in .rodata. */
+#define __in_flash(group)
+
+#endif
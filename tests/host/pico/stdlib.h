@@ -0,0 +1,8 @@
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include <stdint.h>
+
+uint64_t time_us_64(void);
+
+#endif
@@ -0,0 +1,62 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/platform.h"
+
+#include "pico-cec/util.h"
+
+#include "cec-id.h"
+#include "cec-user.h"
+
+/**
+ * Name table order check.
+ *
+ * util_name_find() binary searches the index, so a list that is not strictly
+ * ascending loses names without any other sign. Each list is built into a
+ * table as the firmware does, checked for order and every name looked up.
+ */
+
+UTIL_NAME_TABLE(cec_message, CEC_MESSAGE_NAMES);
+UTIL_NAME_TABLE(cec_feature_abort, CEC_FEATURE_ABORT_NAMES);
+UTIL_NAME_TABLE(user_control, CEC_USER_CONTROL_NAMES);
+
+/** util.c is linked for util_name_find(), its uptime is not used. */
+uint64_t time_us_64(void) {
+  return 0;
+}
+
+static int check(const char *table, const util_name_t *index, size_t count, const char *pool) {
+  int failed = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0 && index[i - 1].key >= index[i].key) {
+      fprintf(stderr, "%s: 0x%02x \"%s\" not above 0x%02x \"%s\"\n", table, index[i].key,
+              &pool[index[i].offset], index[i - 1].key, &pool[index[i - 1].offset]);
+      failed = 1;
+    }
+    const char *name = util_name_find(index, count, pool, index[i].key);
+    if (name == NULL || strcmp(name, &pool[index[i].offset]) != 0) {
+      fprintf(stderr, "%s: 0x%02x \"%s\" not found\n", table, index[i].key,
+              &pool[index[i].offset]);
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
+
+#define CHECK(table)                                                             \
+  check(#table, table##_index, sizeof(table##_index) / sizeof(table##_index[0]), \
+        (const char *)&table##_pool)
+
+int main(void) {
+  int failed = 0;
+
+  failed |= CHECK(cec_message);
+  failed |= CHECK(cec_feature_abort);
+  failed |= CHECK(user_control);
+
+  return failed;
+}
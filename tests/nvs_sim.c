@@ -0,0 +1,674 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * NVS power loss simulation.
+ *
+ * nvs.c is built against a RAM backed flash, which can lose power after any
+ * number of bytes have been programmed or part way through an erase. After
+ * every such cut the NVS module is rebooted and must find the last good
+ * configuration, EDID fingerprint and macros, then carry on saving. The module is
+ * included here so a reboot can reset its state and the stored formats of
+ * older versions can be built.
+ */
+
+#include "../src/nvs.c"
+
+#define REGION_SIZE (4 * FLASH_SECTOR_SIZE)
+
+/** The NVS region, __CEC_NVS_LEN is defined at link time to match. */
+uint32_t CEC_NVS_BASE_ADDR[REGION_SIZE / sizeof(uint32_t)]
+    __attribute__((aligned(FLASH_SECTOR_SIZE)));
+
+#define region ((uint8_t *)CEC_NVS_BASE_ADDR)
+
+/** Bytes left to program or erase before power is lost, -1 for never. */
+static long power = -1;
+static bool powered = true;
+static unsigned long erases[REGION_SIZE / FLASH_SECTOR_SIZE];
+static int failures = 0;
+
+volatile uint32_t cec_log_modules = 0;
+
+#define expect(cond, ...)                     \
+  do {                                        \
+    if (!(cond)) {                            \
+      printf("%s:%d: ", __func__, __LINE__);  \
+      printf(__VA_ARGS__);                    \
+      printf("\n");                           \
+      failures++;                             \
+    }                                         \
+  } while (0)
+
+uint32_t crc32(const unsigned char *buf, unsigned int len) {
+  uint32_t crc = 0xffffffff;
+
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  }
+
+  return ~crc;
+}
+
+static uint8_t *flash_at(uint32_t flash_offs, size_t count) {
+  uint32_t offset = flash_offs - nvs_get_flash_address();
+
+  if (offset > REGION_SIZE || count > (REGION_SIZE - offset)) {
+    printf("flash access outside the NVS region: 0x%08lx\n", (unsigned long)flash_offs);
+    abort();
+  }
+
+  return &region[offset];
+}
+
+/**
+ * Take count bytes of the remaining power, returns how many can be done.
+ */
+static size_t draw(size_t count) {
+  if (!powered) {
+    return 0;
+  }
+  if (power < 0 || (size_t)power > count) {
+    if (power >= 0) {
+      power -= count;
+    }
+    return count;
+  }
+
+  size_t done = power;
+  power = 0;
+  powered = false;
+
+  return done;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+  uint8_t *flash = flash_at(flash_offs, count);
+
+  if ((flash_offs % FLASH_SECTOR_SIZE) != 0 || (count % FLASH_SECTOR_SIZE) != 0) {
+    printf("unaligned erase: 0x%08lx %zu\n", (unsigned long)flash_offs, count);
+    abort();
+  }
+
+  // an interrupted erase leaves the start of the sector erased
+  memset(flash, 0xff, draw(count));
+  erases[(flash - region) / FLASH_SECTOR_SIZE]++;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+  uint8_t *flash = flash_at(flash_offs, count);
+
+  if ((flash_offs % FLASH_PAGE_SIZE) != 0 || (count % FLASH_PAGE_SIZE) != 0) {
+    printf("unaligned program: 0x%08lx %zu\n", (unsigned long)flash_offs, count);
+    abort();
+  }
+
+  // programming only ever clears bits
+  size_t done = draw(count);
+  for (size_t i = 0; i < done; i++) {
+    flash[i] &= data[i];
+  }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+  buffer->taken = 0;
+  return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+  StaticSemaphore_t *semaphore = mutex;
+
+  (void)ticks;
+  if (semaphore->taken++ != 0) {
+    printf("NVS mutex taken recursively\n");
+    abort();
+  }
+
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  StaticSemaphore_t *semaphore = mutex;
+
+  semaphore->taken--;
+
+  return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return 0;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  (void)ticks;
+}
+
+void vTaskSuspendAll(void) {
+}
+
+BaseType_t xTaskResumeAll(void) {
+  return pdFALSE;
+}
+
+uint32_t cec_frame_idle_us(void) {
+  return NVS_BUS_IDLE_US;
+}
+
+void cec_frame_flash_begin(void) {
+}
+
+void cec_frame_flash_end(void) {
+}
+
+void cec_log_submitf(const char *fmt, ...) {
+  (void)fmt;
+}
+
+void cec_config_set_default(cec_config_t *config) {
+  memset(config, 0, sizeof(*config));
+  config->edid_delay_ms = 5000;
+  config->device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
+  config->keymap_type = CEC_CONFIG_KEYMAP_KODI;
+  config->hid_interval_ms = 10;
+}
+
+void cec_config_set_keymap(cec_config_t *config) {
+  (void)config;
+}
+
+/**
+ * Power cycle, forgetting everything nvs.c found before.
+ */
+static void reboot(void) {
+  stored = NULL;
+  validated = false;
+  edid_slot = -1;
+  edid_validated = false;
+  macro_slot = -1;
+  macro_validated = false;
+  power = -1;
+  powered = true;
+  nvs_init();
+}
+
+static void format(void) {
+  memset(region, 0xff, REGION_SIZE);
+  memset(erases, 0, sizeof(erases));
+  reboot();
+}
+
+static void make_config(cec_config_t *config, uint32_t n) {
+  cec_config_set_default(config);
+  config->edid_delay_ms = n;
+  config->physical_address = n & 0xffff;
+  memset(config->keymap, n & 0xff, sizeof(config->keymap));
+}
+
+static void make_macros(uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH], uint32_t n) {
+  memset(macros, 0, HID_MACRO_COUNT * HID_MACRO_LENGTH);
+  macros[n % HID_MACRO_COUNT][0] = HID_MACRO_OP_DOWN;
+  macros[n % HID_MACRO_COUNT][1] = n & 0xff;
+  macros[0][HID_MACRO_LENGTH - 1] = (n >> 8) & 0xff;
+}
+
+static void make_edid(nvs_edid_t *edid, uint32_t n) {
+  memset(edid, 0, sizeof(*edid));
+  edid->block_crc = n;
+  edid->speed = n & 0x01;
+  edid->info.physical_address = n & 0xffff;
+  snprintf(edid->info.name, sizeof(edid->info.name), "sink %04x", (unsigned int)(n & 0xffff));
+}
+
+/** Saves made so far, the last successful one of each type, 0 if none. */
+typedef struct {
+  uint32_t next;
+  uint32_t config;
+  uint32_t edid;
+  uint32_t macros;
+} history_t;
+
+/** Every third save is an EDID and some of the rest macros, so every record type shares the log. */
+static bool is_edid(uint32_t n) {
+  return (n % 3) == 0;
+}
+
+static bool is_macros(uint32_t n) {
+  return !is_edid(n) && (n % 5) == 0;
+}
+
+static bool is_config(uint32_t n) {
+  return n != 0 && !is_edid(n) && !is_macros(n);
+}
+
+static bool save(history_t *history) {
+  uint32_t n = ++history->next;
+
+  if (is_edid(n)) {
+    nvs_edid_t edid;
+    make_edid(&edid, n);
+    if (!nvs_save_edid(&edid)) {
+      return false;
+    }
+    history->edid = n;
+  } else if (is_macros(n)) {
+    uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+    make_macros(macros, n);
+    if (!nvs_save_macros(macros)) {
+      return false;
+    }
+    history->macros = n;
+  } else {
+    cec_config_t config;
+    make_config(&config, n);
+    if (!nvs_save_config(&config)) {
+      return false;
+    }
+    history->config = n;
+  }
+
+  return true;
+}
+
+/**
+ * Check the stored records are those of a save in history, or the one after.
+ */
+static void check(const history_t *history, uint32_t pending, const char *when) {
+  cec_config_t config;
+  cec_config_t expected;
+  nvs_edid_t edid;
+  nvs_edid_t expected_edid;
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+  uint8_t expected_macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+  // none saved yet is also the last good state
+  bool found = nvs_read_config(&config);
+  make_config(&expected, history->config);
+  bool last = history->config == 0 ? !found
+                                    : found && memcmp(&config, &expected, sizeof(config)) == 0;
+  make_config(&expected, pending);
+  bool next = found && is_config(pending) && memcmp(&config, &expected, sizeof(config)) == 0;
+  expect(last || next, "%s: config %lu, expected %lu", when,
+         (unsigned long)(found ? config.edid_delay_ms : 0), (unsigned long)history->config);
+  expect(!found || nvs_get_config() != NULL, "%s: current config not usable in place", when);
+
+  found = nvs_read_edid(&edid);
+  make_edid(&expected_edid, history->edid);
+  last = history->edid == 0 ? !found : found && memcmp(&edid, &expected_edid, sizeof(edid)) == 0;
+  make_edid(&expected_edid, pending);
+  next = found && pending != 0 && is_edid(pending) &&
+         memcmp(&edid, &expected_edid, sizeof(edid)) == 0;
+  expect(last || next, "%s: EDID %lu, expected %lu", when,
+         (unsigned long)(found ? edid.block_crc : 0), (unsigned long)history->edid);
+
+  found = nvs_read_macros(macros);
+  make_macros(expected_macros, history->macros);
+  last = history->macros == 0 ? !found
+                              : found && memcmp(macros, expected_macros, sizeof(macros)) == 0;
+  make_macros(expected_macros, pending);
+  next = found && pending != 0 && is_macros(pending) &&
+         memcmp(macros, expected_macros, sizeof(macros)) == 0;
+  expect(last || next, "%s: macros %u, expected %lu", when,
+         found ? macros[pending % HID_MACRO_COUNT][1] : 0, (unsigned long)history->macros);
+}
+
+/**
+ * Cut the power at every byte of every save, through several trips around
+ * the region, and check the last good records survive each cut.
+ */
+static void test_power_loss(void) {
+  static uint8_t snapshot[REGION_SIZE];
+  history_t history = {0};
+  char when[64];
+
+  format();
+
+  unsigned int saves = 3 * slot_count();
+  for (unsigned int i = 0; i < saves; i++) {
+    memcpy(snapshot, region, REGION_SIZE);
+    uint32_t pending = history.next + 1;
+
+    for (long cut = 0;; cut++) {
+      // each cut starts from the flash as it was before the save
+      memcpy(region, snapshot, REGION_SIZE);
+      reboot();
+      history_t attempt = history;
+
+      power = cut;
+      bool saved = save(&attempt);
+      bool interrupted = !powered;
+
+      // a save reported done must be found, otherwise either record may be
+      reboot();
+      snprintf(when, sizeof(when), "save %lu cut at %ld", (unsigned long)pending, cut);
+      check(saved ? &attempt : &history, saved ? 0 : pending, when);
+
+      // the log must carry on after the interrupted save
+      attempt = history;
+      attempt.next = pending;
+      snprintf(when, sizeof(when), "save after %lu cut at %ld", (unsigned long)pending, cut);
+      expect(save(&attempt), "%s failed", when);
+      reboot();
+      check(&attempt, pending, when);
+
+      if (!interrupted) {
+        break;
+      }
+    }
+
+    // and finally the save goes through
+    memcpy(region, snapshot, REGION_SIZE);
+    reboot();
+    expect(save(&history), "save %lu failed", (unsigned long)pending);
+    reboot();
+    snprintf(when, sizeof(when), "save %lu", (unsigned long)pending);
+    check(&history, 0, when);
+  }
+
+  printf("power loss: %u saves, erases", saves);
+  for (unsigned int sector = 0; sector < REGION_SIZE / FLASH_SECTOR_SIZE; sector++) {
+    printf(" %lu", erases[sector]);
+  }
+  printf("\n");
+}
+
+/**
+ * Save configurations until the log wraps several times, while one EDID and
+ * one macro record are kept current throughout.
+ */
+static void test_wrap(void) {
+  history_t history = {.next = 5};
+  nvs_edid_t edid;
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+  format();
+
+  make_edid(&edid, 3);
+  expect(nvs_save_edid(&edid), "EDID save failed");
+  history.edid = 3;
+
+  // the macros in the next sector
+  unsigned int saves = NVS_SLOTS_PER_SECTOR - 1;
+  for (unsigned int i = 0; i < saves; i++) {
+    cec_config_t config;
+    make_config(&config, 100 + i);
+    expect(nvs_save_config(&config), "config save %u failed", i);
+  }
+  make_macros(macros, 5);
+  expect(nvs_save_macros(macros), "macro save failed");
+  history.macros = 5;
+
+  saves = 10 * slot_count();
+  for (unsigned int i = 0; i < saves; i++) {
+    cec_config_t config;
+    make_config(&config, 6 + i);
+    expect(nvs_save_config(&config), "config save %u failed", i);
+    history.config = 6 + i;
+  }
+
+  reboot();
+  check(&history, 0, "wrap");
+
+  unsigned int sectors = REGION_SIZE / FLASH_SECTOR_SIZE;
+  unsigned int sector = edid_slot / NVS_SLOTS_PER_SECTOR;
+  unsigned int macro_sector = macro_slot / NVS_SLOTS_PER_SECTOR;
+  expect(macro_sector != sector, "EDID and macros in the same sector");
+  for (unsigned int i = 0; i < sectors; i++) {
+    if (i == sector) {
+      expect(erases[i] == 0, "sector %u holding the EDID erased %lu times", i, erases[i]);
+    } else if (i == macro_sector) {
+      expect(erases[i] == 0, "sector %u holding the macros erased %lu times", i, erases[i]);
+    } else {
+      expect(erases[i] > 0, "sector %u never erased", i);
+    }
+  }
+}
+
+/**
+ * The newest record is damaged, the scan must fall back to the one before.
+ */
+static void test_newest_valid(void) {
+  history_t history = {0};
+
+  format();
+
+  for (unsigned int i = 0; i < slot_count() + 2; i++) {
+    expect(save(&history), "save %u failed", i);
+  }
+  reboot();
+  check(&history, 0, "before damage");
+
+  // newest config, past the end of the region so in a low slot
+  int slot = find_record(NVS_RECORD_MAGIC, UINT32_MAX);
+  uint32_t newest = record_at(slot)->nvs.config.edid_delay_ms;
+  region[slot_offset(slot) + offsetof(nvs_record_t, nvs.config.keymap)] ^= 0x01;
+
+  // the one before it
+  int older = find_record(NVS_RECORD_MAGIC, record_at(slot)->sequence);
+  history.config = record_at(older)->nvs.config.edid_delay_ms;
+  expect(history.config < newest, "config %lu not older than %lu",
+         (unsigned long)history.config, (unsigned long)newest);
+
+  reboot();
+  check(&history, 0, "damaged newest");
+
+  // and a damaged sequence number hides the record altogether
+  region[slot_offset(older) + offsetof(nvs_record_t, sequence)] ^= 0x80;
+  reboot();
+  cec_config_t config;
+  expect(nvs_read_config(&config), "no config after two damaged records");
+  expect(config.edid_delay_ms < history.config, "config %lu not older than %lu",
+         (unsigned long)config.edid_delay_ms, (unsigned long)history.config);
+}
+
+/**
+ * Store a bare pre record log configuration of version 1 to 4.
+ */
+static void store_legacy(uint8_t version, const cec_config_nvs_t *body) {
+  pico_cec_nvs_t nvs;
+  size_t size = version == CEC_CONFIG_VERSION_01 ? sizeof(cec_config_nvs_v1_t)
+                                                 : config_size(version);
+
+  memset(&nvs, 0, sizeof(nvs));
+  nvs.header.version = version;
+  nvs.header.length = size;
+  nvs.header_crc = crc32((unsigned char *)&nvs.header, sizeof(nvs.header));
+
+  if (version == CEC_CONFIG_VERSION_01) {
+    cec_config_nvs_v1_t v1;
+    v1.edid_delay_ms = body->edid_delay_ms;
+    v1.physical_address = body->physical_address;
+    memcpy(v1.keymap, body->keymap, sizeof(v1.keymap));
+    memcpy(&nvs.config, &v1, sizeof(v1));
+    nvs.config_crc = crc32((unsigned char *)&v1, sizeof(v1));
+    memcpy(region, &nvs, sizeof(nvs));
+    return;
+  }
+
+  // the CRC follows the word aligned body of the version
+  unsigned char *bytes = (unsigned char *)&nvs.config;
+  memcpy(bytes, body, size);
+  uint32_t crc = crc32(bytes, size);
+  memcpy(region, &nvs, offsetof(pico_cec_nvs_t, config));
+  memcpy(&region[offsetof(pico_cec_nvs_t, config)], bytes, size);
+  memcpy(&region[offsetof(pico_cec_nvs_t, config) + ((size + 3) & ~3)], &crc, sizeof(crc));
+}
+
+/**
+ * Store a version 5 or 6 record, the in-memory configuration with the macros
+ * inline, version 5 before audio_system.
+ */
+static void store_v6(uint8_t version, const cec_config_v6_t *config) {
+  const size_t size = version == CEC_CONFIG_VERSION_05 ? offsetof(cec_config_v6_t, audio_system)
+                                                       : sizeof(cec_config_v6_t);
+  nvs_record_t record;
+
+  memset(&record, 0xff, sizeof(record));
+  record.magic = NVS_RECORD_MAGIC;
+  record.sequence = 1;
+  record.sequence_crc = crc32((unsigned char *)&record, offsetof(nvs_record_t, sequence_crc));
+  record.nvs.header.version = version;
+  record.nvs.header.length = size;
+  record.nvs.header_crc =
+      crc32((unsigned char *)&record.nvs.header, sizeof(record.nvs.header));
+
+  unsigned char *body = (unsigned char *)&record.nvs.config;
+  memcpy(body, config, size);
+  uint32_t crc = crc32(body, size);
+  memcpy(&body[size], &crc, sizeof(crc));
+
+  memcpy(region, &record, sizeof(record));
+}
+
+/**
+ * Check the migrated macros, none expected if NULL.
+ */
+static void check_macros(const char *when,
+                         const uint8_t expected[HID_MACRO_COUNT][HID_MACRO_LENGTH]) {
+  uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH];
+
+  bool found = nvs_read_macros(macros);
+  expect(found == (expected != NULL), "%s: macros %s", when, found ? "found" : "not found");
+  if (found && expected != NULL) {
+    expect(memcmp(macros, expected, sizeof(macros)) == 0, "%s: migrated macros differ", when);
+  }
+}
+
+/**
+ * Check the migrated configuration and macros, then that they survive the
+ * first save.
+ */
+static void check_migrated(uint8_t version, const cec_config_t *expected,
+                           const uint8_t macros[HID_MACRO_COUNT][HID_MACRO_LENGTH]) {
+  static uint8_t snapshot[REGION_SIZE];
+  cec_config_t config;
+  char when[64];
+
+  snprintf(when, sizeof(when), "v%u", version);
+  reboot();
+  expect((nvs_get_config() == NULL) == (version != CEC_CONFIG_VERSION),
+         "%s: usable in place only if current", when);
+  expect(nvs_read_config(&config), "%s: not found", when);
+  expect(memcmp(&config, expected, sizeof(config)) == 0, "%s: migrated config differs", when);
+  check_macros(when, macros);
+
+  // losing power during the first save must keep the old version
+  memcpy(snapshot, region, REGION_SIZE);
+  for (long cut = 0;; cut++) {
+    memcpy(region, snapshot, REGION_SIZE);
+    reboot();
+    nvs_read_config(&config);
+    power = cut;
+    nvs_save_config(&config);
+    bool interrupted = !powered;
+
+    reboot();
+    expect(nvs_read_config(&config), "%s: lost with a cut at %ld", when, cut);
+    expect(memcmp(&config, expected, sizeof(config)) == 0, "%s: differs after a cut at %ld",
+           when, cut);
+    check_macros(when, macros);
+
+    if (!interrupted) {
+      break;
+    }
+  }
+
+  reboot();
+  expect(nvs_get_config() != NULL, "%s: not current after save", when);
+  expect(nvs_read_config(&config), "%s: not found after save", when);
+  expect(memcmp(&config, expected, sizeof(config)) == 0, "%s: differs after save", when);
+  check_macros(when, macros);
+}
+
+static void test_migration(void) {
+  cec_config_nvs_t body;
+  cec_config_t expected;
+  cec_config_v6_t inline_macros;
+
+  memset(&body, 0, sizeof(body));
+  body.edid_delay_ms = 1234;
+  body.physical_address = 0x2100;
+  body.logical_address = 4;
+  body.device_type = CEC_CONFIG_DEVICE_TYPE_TV;
+  body.keymap_type = CEC_CONFIG_KEYMAP_CUSTOM;
+  for (unsigned int i = 0; i < sizeof(body.keymap); i++) {
+    body.keymap[i] = i ^ 0x5a;
+  }
+  for (unsigned int i = 0; i < HID_MACRO_COUNT; i++) {
+    body.macros[i][0] = i + 1;
+  }
+  body.hid_interval_ms = 4;
+
+  for (uint8_t version = CEC_CONFIG_VERSION_01; version <= CEC_CONFIG_VERSION_04; version++) {
+    format();
+    store_legacy(version, &body);
+
+    cec_config_set_default(&expected);
+    expected.edid_delay_ms = body.edid_delay_ms;
+    expected.physical_address = body.physical_address;
+    memcpy(expected.keymap, body.keymap, sizeof(expected.keymap));
+    if (version >= CEC_CONFIG_VERSION_02) {
+      expected.logical_address = body.logical_address;
+      // a TV device type was never used, it became playback
+      expected.device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
+      expected.keymap_type = body.keymap_type;
+    }
+    if (version >= CEC_CONFIG_VERSION_04) {
+      expected.hid_interval_ms = body.hid_interval_ms;
+    }
+
+    // macros from v3, moved to their own record by the first save
+    check_migrated(version, &expected, version >= CEC_CONFIG_VERSION_03 ? body.macros : NULL);
+  }
+
+  // v5 and v6 were the in-memory configuration with the macros inline, v5
+  // before audio_system which keeps its default
+  for (uint8_t version = CEC_CONFIG_VERSION_05; version <= CEC_CONFIG_VERSION_06; version++) {
+    format();
+    make_config(&expected, 77);
+    memset(&inline_macros, 0, sizeof(inline_macros));
+    inline_macros.edid_delay_ms = expected.edid_delay_ms;
+    inline_macros.physical_address = expected.physical_address;
+    inline_macros.logical_address = expected.logical_address;
+    inline_macros.device_type = expected.device_type;
+    inline_macros.keymap_type = expected.keymap_type;
+    memcpy(inline_macros.keymap, expected.keymap, sizeof(inline_macros.keymap));
+    make_macros(inline_macros.macros, version);
+    inline_macros.hid_interval_ms = expected.hid_interval_ms;
+    inline_macros.audio_system = true;
+    store_v6(version, &inline_macros);
+    expected.audio_system = version == CEC_CONFIG_VERSION_06;
+    check_migrated(version, &expected, inline_macros.macros);
+  }
+
+  // and the current version is used in place, the macros in their own record
+  format();
+  make_config(&expected, 78);
+  expected.audio_system = true;
+  make_macros(inline_macros.macros, 78);
+  expect(nvs_save_macros(inline_macros.macros), "v7: macro save failed");
+  expect(nvs_save_config(&expected), "v7: save failed");
+  check_migrated(CEC_CONFIG_VERSION, &expected, inline_macros.macros);
+
+  // unchanged macros are not saved again
+  int slot = macro_slot;
+  expect(nvs_save_macros(inline_macros.macros), "v7: unchanged macro save failed");
+  expect(macro_slot == slot, "v7: unchanged macros saved again");
+}
+
+int main(void) {
+  test_migration();
+  test_newest_valid();
+  test_wrap();
+  test_power_loss();
+
+  printf("%s: %d failures\n", failures ? "FAIL" : "PASS", failures);
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}